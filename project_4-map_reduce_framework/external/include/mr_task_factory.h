@@ -6,6 +6,7 @@
 #include <memory>
 #include <vector>
 #include <functional>
+#include <string_view>
 
 class Worker;
 
@@ -20,6 +21,10 @@ class BaseMapper {
 		virtual void map(const std::string& input_line) = 0;
 		void emit(const std::string& key, const std::string& val);
 
+		/* Called by the framework with a zero-copy slice of the input. Override it to skip the copy;
+			by default the line is copied into a reused buffer and passed to map() */
+		virtual void map_view(std::string_view input_line);
+
 	private:
 		friend class Worker;
 		BaseMapperInternal* impl_;
@@ -43,8 +48,34 @@ class BaseReducer {
 };
 
 
+class BaseCombinerInternal;
+/* Optional map-side combiner: collapses the values a single mapper emitted for a key before they hit disk.
+	Must be safe to apply zero or more times (e.g. a partial sum), since it runs on every flush */
+class BaseCombiner {
+
+	public:
+		BaseCombiner();
+		virtual ~BaseCombiner();
+		
+		virtual void combine(const std::string& key, const std::vector<std::string>& values) = 0;
+		void emit(const std::string& key, const std::string& val);
+
+	private:
+		friend class Worker;
+		friend class BaseMapperInternal;
+		BaseCombinerInternal* impl_;
+};
+
+
 /* Register user's implementation of the tasks with a user id same as user_id in the config.ini */
 bool register_tasks(
 	std::string user_id, std::function<std::shared_ptr<BaseMapper>() >& generate_mapper, 
 	std::function<std::shared_ptr<BaseReducer>() >& generate_reducer
 	);
+
+/* Same as above, additionally registering a combiner that runs inside each map task */
+bool register_tasks(
+	std::string user_id, std::function<std::shared_ptr<BaseMapper>() >& generate_mapper, 
+	std::function<std::shared_ptr<BaseReducer>() >& generate_reducer,
+	std::function<std::shared_ptr<BaseCombiner>() >& generate_combiner
+	);
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define MR_TOKENIZER_X86 1
+#include <immintrin.h>
+#endif
+
+
+/* Splits text on a set of single-byte delimiters, like strtok_r but without copying the line: each token
+	is passed to the callback as a string_view into the input, and empty tokens are skipped. On x86 the
+	delimiters are found 32 bytes at a time with AVX2, or 16 with SSE2, picked once at runtime
+	(MR_TOKENIZER_NO_AVX2 pins SSE2); other targets and sets of more than MAX_SIMD_DELIMS delimiters
+	use a 256-entry lookup table.
+
+		static const DelimiterTokenizer words(" ,.\"'");
+		void map_view(std::string_view line) override {
+			words.for_each(line, [&](std::string_view w) { emit(std::string(w), "1"); });
+		}
+*/
+class DelimiterTokenizer {
+
+	public:
+		static constexpr size_t MAX_SIMD_DELIMS = 8;
+
+		explicit DelimiterTokenizer(std::string_view delims) {
+			for (unsigned char c : delims) {
+				if (is_delim_[c]) continue;
+				is_delim_[c] = true;
+				if (n_delims_ < MAX_SIMD_DELIMS) delims_[n_delims_] = static_cast<char>(c);
+				++n_delims_;
+			}
+		}
+
+		/* Calls f(std::string_view) for every token of text, in order */
+		template <typename F>
+		void for_each(std::string_view text, F&& f) const {
+#ifdef MR_TOKENIZER_X86
+			if (n_delims_ > 0 && n_delims_ <= MAX_SIMD_DELIMS) {
+				if (has_avx2_()) split_avx2_(text, f);
+				else             split_sse2_(text, f);
+				return;
+			}
+#endif
+			split_scalar_(text, 0, 0, false, f);
+		}
+
+		bool is_delim(char c) const { return is_delim_[static_cast<unsigned char>(c)]; }
+
+	private:
+		/* Walks the tokens of text from pos on; start and in_token carry a token begun before pos */
+		template <typename F>
+		void split_scalar_(std::string_view text, size_t pos, size_t start, bool in_token, F& f) const {
+			for (; pos < text.size(); ++pos) {
+				const bool d = is_delim(text[pos]);
+				if (in_token && d) {
+					f(text.substr(start, pos - start));
+					in_token = false;
+				} else if (!in_token && !d) {
+					start = pos;
+					in_token = true;
+				}
+			}
+			if (in_token) f(text.substr(start));
+		}
+
+		/* One block of width bits: mask has a bit set per delimiter byte. Emits the tokens that end in
+			this block and leaves an unfinished one in start/in_token */
+		template <typename F>
+		static void walk_block_(std::string_view text, size_t base, uint64_t mask, unsigned width,
+		                        size_t& start, bool& in_token, F& f) {
+			const uint64_t all = width == 64 ? ~0ull : (1ull << width) - 1;
+			unsigned bit = 0;
+			while (bit < width) {
+				const uint64_t rest = (in_token ? mask : ~mask & all) >> bit;
+				if (rest == 0) break;
+				bit += static_cast<unsigned>(__builtin_ctzll(rest));
+				if (in_token) f(text.substr(start, base + bit - start));
+				else          start = base + bit;
+				in_token = !in_token;
+			}
+		}
+
+#ifdef MR_TOKENIZER_X86
+		static bool has_avx2_() {
+#ifdef MR_TOKENIZER_NO_AVX2
+			return false;
+#else
+			static const bool avx2 = __builtin_cpu_supports("avx2");
+			return avx2;
+#endif
+		}
+
+		template <typename F>
+		__attribute__((target("sse2")))
+		void split_sse2_(std::string_view text, F& f) const {
+			__m128i needles[MAX_SIMD_DELIMS];
+			for (size_t d = 0; d < n_delims_; ++d) needles[d] = _mm_set1_epi8(delims_[d]);
+			size_t pos = 0, start = 0;
+			bool in_token = false;
+			for (; pos + 16 <= text.size(); pos += 16) {
+				const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text.data() + pos));
+				__m128i hits = _mm_cmpeq_epi8(block, needles[0]);
+				for (size_t d = 1; d < n_delims_; ++d) hits = _mm_or_si128(hits, _mm_cmpeq_epi8(block, needles[d]));
+				const uint64_t mask = static_cast<uint32_t>(_mm_movemask_epi8(hits));
+				walk_block_(text, pos, mask, 16, start, in_token, f);
+			}
+			split_scalar_(text, pos, start, in_token, f);
+		}
+
+		template <typename F>
+		__attribute__((target("avx2")))
+		void split_avx2_(std::string_view text, F& f) const {
+			__m256i needles[MAX_SIMD_DELIMS];
+			for (size_t d = 0; d < n_delims_; ++d) needles[d] = _mm256_set1_epi8(delims_[d]);
+			size_t pos = 0, start = 0;
+			bool in_token = false;
+			for (; pos + 32 <= text.size(); pos += 32) {
+				const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text.data() + pos));
+				__m256i hits = _mm256_cmpeq_epi8(block, needles[0]);
+				for (size_t d = 1; d < n_delims_; ++d) hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(block, needles[d]));
+				const uint64_t mask = static_cast<uint32_t>(_mm256_movemask_epi8(hits));
+				walk_block_(text, pos, mask, 32, start, in_token, f);
+			}
+			split_scalar_(text, pos, start, in_token, f);
+		}
+#endif
+
+		std::array<bool, 256>             is_delim_{};
+		std::array<char, MAX_SIMD_DELIMS> delims_{};
+		size_t                            n_delims_ = 0;
+};
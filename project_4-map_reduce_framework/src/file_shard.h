@@ -6,14 +6,20 @@
 #include <cmath>
 #include <sstream>
 #include <iostream>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <atomic>
+#include <thread>
 
 
 /* CS6210_TASK: Create your own data structure here, where you can hold information about file splits,
      that your master would use for its own bookkeeping and to convey the tasks to the workers for mapping */
 struct FilePiece {
      std::string filepath;
-     size_t start_offset;
-     size_t end_offset;
+     uint64_t start_offset;  // int64 on the wire (masterworker.proto)
+     uint64_t end_offset;
 };
      
 struct FileShard {
@@ -22,56 +28,133 @@ struct FileShard {
      
 
 
+/* map_kilobytes=auto: rough cost model for the per-task overhead floor. A map task pays about
+	TASK_OVERHEAD_MS (RPC, directory creation, writing n_output files) on top of reading its shard
+	at MAP_BYTES_PER_SEC; a shard must be big enough that the overhead stays under MAX_OVERHEAD_FRACTION */
+static constexpr double TASK_OVERHEAD_MS      = 10.0;
+static constexpr double MAP_BYTES_PER_SEC     = 50.0 * 1024 * 1024;
+static constexpr double MAX_OVERHEAD_FRACTION = 0.1;
+
+/* Shard size for map_kilobytes=auto: total / (workers * waves), kept within [min, max], then evened out
+	so the last shard isn't a small leftover. min_shard_kilobytes=0 (the default) uses the overhead floor
+	as the minimum; an explicit value replaces it */
+inline uint64_t auto_shard_size(const MapReduceSpec& mr_spec, uint64_t total) {
+	const uint64_t overhead_floor = static_cast<uint64_t>(
+		TASK_OVERHEAD_MS / 1000.0 * MAP_BYTES_PER_SEC * (1.0 - MAX_OVERHEAD_FRACTION) / MAX_OVERHEAD_FRACTION);
+	const uint64_t lo = mr_spec.min_shard_kilobytes > 0
+		? static_cast<uint64_t>(mr_spec.min_shard_kilobytes) * 1024
+		: overhead_floor;
+	const uint64_t hi = std::max<uint64_t>(static_cast<uint64_t>(mr_spec.max_shard_kilobytes) * 1024, lo);
+
+	const uint64_t n_tasks = static_cast<uint64_t>(std::max(1, mr_spec.n_workers)) * mr_spec.shard_waves_per_worker;
+	const uint64_t target = std::clamp<uint64_t>((total + n_tasks - 1) / n_tasks, lo, hi);
+
+	const uint64_t n_shards = std::max<uint64_t>(1, (total + target - 1) / target);
+	return std::max<uint64_t>(1, (total + n_shards - 1) / n_shards);
+}
+
+
+/* Returns the first line start at or after offset in an open file of size file_size
+	(file_size itself if the remaining bytes are one unterminated line) */
+inline uint64_t next_line_start(std::ifstream& in, uint64_t offset, uint64_t file_size) {
+	if (offset == 0 || offset >= file_size) return std::min(offset, file_size);
+
+	// offset is a line start iff the byte before it is '\n'; otherwise scan forward to the next one
+	char buf[4096];
+	uint64_t pos = offset - 1;
+	while (pos < file_size) {
+		in.clear();
+		in.seekg(static_cast<std::streamoff>(pos));
+		size_t want = static_cast<size_t>(std::min<uint64_t>(sizeof(buf), file_size - pos));
+		in.read(buf, static_cast<std::streamsize>(want));
+		size_t got = static_cast<size_t>(in.gcount());
+		if (got == 0) break;
+
+		const char* nl = static_cast<const char*>(std::memchr(buf, '\n', got));
+		if (nl) return pos + static_cast<uint64_t>(nl - buf) + 1;
+		pos += got;
+	}
+	return file_size;
+}
+
+
 /* CS6210_TASK: Create fileshards from the list of input files, map_kilobytes etc. using mr_spec you populated  */ 
+/* The inputs are treated as one concatenated stream cut every map_kilobytes (or auto_shard_size), so small
+	files are coalesced into shared shards rather than getting a task each. Each cut is moved forward
+	to the next '\n' by seeking there and reading a few bytes, so the cost is O(#shards) small reads
+	instead of a full scan. Cuts are resolved per file, in parallel across files */
 inline bool shard_files(const MapReduceSpec& mr_spec, std::vector<FileShard>& fileShards) {
 	std::cout << "file_shard.h: shard_files..." << std::endl;
 	
-	size_t SHARD_SIZE = mr_spec.map_kilobytes * 1024; // convert KB to bytes
-     
-	std::ifstream in;
-	size_t current_shard_bytes = 0;
-	FileShard current_shard;
-
-	for (const auto& file : mr_spec.input_files) {
-		in.open(file);
-		if (!in) {
-			std::cerr << "Failed to open " << file << "\n";
+	const size_t n_files = mr_spec.input_files.size();
+
+	// 1. file sizes and their position in the concatenated stream
+	std::vector<uint64_t> sizes(n_files), bases(n_files + 1, 0);
+	for (size_t i = 0; i < n_files; i++) {
+		std::error_code ec;
+		sizes[i] = static_cast<uint64_t>(std::filesystem::file_size(mr_spec.input_files[i], ec));
+		if (ec) {
+			std::cerr << "Failed to open " << mr_spec.input_files[i] << "\n";
 			return false;
 		}
+		bases[i + 1] = bases[i] + sizes[i];
+	}
+	const uint64_t total = bases[n_files];
 
-		std::string line;
-		size_t offset = 0;
-		// size_t shard_start = 0;
+	const uint64_t SHARD_SIZE = mr_spec.map_kilobytes_auto
+		? auto_shard_size(mr_spec, total)
+		: static_cast<uint64_t>(mr_spec.map_kilobytes) * 1024; // convert KB to bytes
+	if (mr_spec.map_kilobytes_auto) {
+		std::cout << "file_shard.h: auto shard size " << SHARD_SIZE << " bytes for " << total << " input bytes" << std::endl;
+	}
 
-		while (std::getline(in, line)) {
-			size_t line_size = line.size() + 1; // +1 for '\n'
+	// 2. align every target cut k*SHARD_SIZE to a line start. Files are spread over a few threads,
+	//    each resolving the targets that fall inside its files
+	std::vector<std::vector<uint64_t>> file_cuts(n_files);
+	std::atomic<size_t> next_file{0};
+	std::atomic<bool> ok{true};
+	auto resolve = [&]() {
+		for (size_t i = next_file++; i < n_files; i = next_file++) {
+			uint64_t first = std::max<uint64_t>(1, (bases[i] + SHARD_SIZE - 1) / SHARD_SIZE);
+			if (first * SHARD_SIZE >= bases[i + 1]) continue;
 
-			// If adding this line would exceed the shard size, flush current shard
-			if (current_shard_bytes + line_size > SHARD_SIZE && !current_shard.pieces.empty()) {
-				fileShards.push_back(current_shard);
-				current_shard = FileShard();
-				current_shard_bytes = 0;
-				// shard_start = offset;
+			std::ifstream in(mr_spec.input_files[i], std::ios::binary);
+			if (!in) {
+				std::cerr << "Failed to open " << mr_spec.input_files[i] << "\n";
+				ok = false;
+				continue;
 			}
-
-			// Append to current shard
-			if (current_shard.pieces.empty() ||
-			    current_shard.pieces.back().filepath != file) {
-				current_shard.pieces.push_back({file, offset, offset + line_size});
-			} else {
-				current_shard.pieces.back().end_offset += line_size;
+			for (uint64_t k = first; k * SHARD_SIZE < bases[i + 1]; k++) {
+				file_cuts[i].push_back(bases[i] + next_line_start(in, k * SHARD_SIZE - bases[i], sizes[i]));
 			}
-
-			offset += line_size;
-			current_shard_bytes += line_size;
 		}
+	};
+	size_t n_threads = std::min<size_t>(n_files, std::max(1u, std::thread::hardware_concurrency()));
+	std::vector<std::thread> threads;
+	for (size_t t = 0; t < n_threads; t++) threads.emplace_back(resolve);
+	for (auto& t : threads) t.join();
+	if (!ok) return false;
 
-		in.close();
+	std::vector<uint64_t> cuts = {0};
+	for (const auto& fc : file_cuts) {
+		for (uint64_t c : fc) {
+			if (c > cuts.back() && c < total) cuts.push_back(c);  // a line longer than a shard swallows later targets
+		}
 	}
+	cuts.push_back(total);
 
-	// Push last shard
-	if (!current_shard.pieces.empty()) {
-		fileShards.push_back(current_shard);
+	// 3. turn [cut_k, cut_k+1) ranges of the stream into per-file pieces
+	size_t file = 0;
+	for (size_t k = 0; k + 1 < cuts.size(); k++) {
+		FileShard shard;
+		uint64_t pos = cuts[k];
+		while (pos < cuts[k + 1]) {
+			while (bases[file + 1] <= pos) file++;  // also skips empty files
+			uint64_t end = std::min(cuts[k + 1], bases[file + 1]);
+			shard.pieces.push_back({mr_spec.input_files[file], pos - bases[file], end - bases[file]});
+			pos = end;
+		}
+		if (!shard.pieces.empty()) fileShards.push_back(std::move(shard));
 	}
 
 	return true;
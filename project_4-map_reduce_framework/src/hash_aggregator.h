@@ -0,0 +1,80 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+/* Groups a reducer's records by key for reduce_mode=hash: an open-addressing table (linear probing,
+	power-of-two capacity, at most half full) maps each key to its group, and groups keep their values
+	in arrival order. Nothing is sorted, so groups come out in first-seen order. The whole partition
+	is held in memory, which is what the sorted mode's k-way merge avoids; bytes() lets the caller
+	bound it */
+class HashAggregator {
+
+	public:
+		struct Group {
+			std::string              key;
+			std::vector<std::string> values;
+		};
+
+		explicit HashAggregator(size_t initial_capacity = 1024) { rehash_(initial_capacity); }
+
+		void add(std::string_view key, std::string_view val) {
+			const uint64_t h = std::hash<std::string_view>{}(key);
+			size_t i = h & mask_;
+			while (slots_[i].group != 0) {
+				Slot& s = slots_[i];
+				if (s.hash == h && groups_[s.group - 1].key == key) {
+					groups_[s.group - 1].values.emplace_back(val);
+					bytes_ += val.size() + sizeof(std::string);
+					return;
+				}
+				i = (i + 1) & mask_;
+			}
+
+			groups_.push_back({std::string(key), {std::string(val)}});
+			slots_[i] = {h, static_cast<uint32_t>(groups_.size())};
+			bytes_ += key.size() + val.size() + sizeof(Group) + sizeof(std::string) + 2 * sizeof(Slot);
+			if (groups_.size() * 2 > slots_.size()) rehash_(slots_.size() * 2);
+		}
+
+		std::vector<Group>& groups() { return groups_; }
+		size_t size() const { return groups_.size(); }
+		size_t bytes() const { return bytes_; }  // memory held, estimated: keys, values and their containers
+
+		void clear() {
+			groups_.clear();
+			std::fill(slots_.begin(), slots_.end(), Slot{});
+			bytes_ = 0;
+		}
+
+	private:
+		struct Slot {
+			uint64_t hash = 0;
+			uint32_t group = 0;  // index into groups_ + 1; 0 = empty
+		};
+
+		/* Grows the table; slots carry their key's hash, so keys are not hashed again */
+		void rehash_(size_t capacity) {
+			size_t n = 16;
+			while (n < capacity) n <<= 1;
+			std::vector<Slot> old(n);
+			old.swap(slots_);
+			mask_ = n - 1;
+			for (const Slot& s : old) {
+				if (s.group == 0) continue;
+				size_t i = s.hash & mask_;
+				while (slots_[i].group != 0) i = (i + 1) & mask_;
+				slots_[i] = s;
+			}
+		}
+
+		std::vector<Slot>  slots_;
+		std::vector<Group> groups_;
+		size_t             mask_ = 0;
+		size_t             bytes_ = 0;
+};
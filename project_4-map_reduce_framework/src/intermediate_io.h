@@ -0,0 +1,368 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <queue>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "lz4_codec.h"
+
+
+/* On-disk layout of the files handed from mappers to reducers.
+	BINARY: one IntermediateFileHeader, then records of [varint key_len][key][varint val_len][val], sorted by key.
+	TEXT:   one "key, val\n" line per record (human readable, meant for debugging).
+	With INTERMEDIATE_FLAG_LZ4 the records after the header are one LZ4 frame (lz4_codec.h). */
+enum class IntermediateFormat { BINARY, TEXT };
+
+/* Block compression of intermediate (BINARY only) and final output files */
+enum class Compression { NONE, LZ4 };
+
+struct IntermediateFileHeader {
+	char     magic[4];   // "MRIF"
+	uint16_t version;
+	uint16_t flags;
+	uint64_t n_records;
+};
+
+static constexpr char     INTERMEDIATE_MAGIC[4]     = {'M', 'R', 'I', 'F'};
+static constexpr uint16_t INTERMEDIATE_VERSION      = 1;
+static constexpr uint16_t INTERMEDIATE_FLAG_SORTED  = 0x1;
+static constexpr uint16_t INTERMEDIATE_FLAG_LZ4     = 0x2;
+
+
+inline const char* intermediate_file_ext(IntermediateFormat format) {
+	return format == IntermediateFormat::TEXT ? ".txt" : ".bin";
+}
+
+/* "mapper_<mapper_id>_reducer_<reducer_id>.{bin,txt}" */
+inline std::string intermediate_file_name(int mapper_id, int reducer_id, IntermediateFormat format) {
+	return "mapper_" + std::to_string(mapper_id) + "_reducer_" + std::to_string(reducer_id)
+		+ intermediate_file_ext(format);
+}
+
+/* ".split_reducer_<reducer_id>.bin": a reducer's results for hot keys split across partitions,
+	reduced once more after the reduce phase. The leading dot keeps it out of the output listing */
+inline std::string split_run_name(int reducer_id) {
+	return ".split_reducer_" + std::to_string(reducer_id) + intermediate_file_ext(IntermediateFormat::BINARY);
+}
+
+inline bool is_split_run(const std::string& filename) {
+	const std::string prefix = ".split_reducer_", ext = intermediate_file_ext(IntermediateFormat::BINARY);
+	return filename.size() > prefix.size() + ext.size() && filename.compare(0, prefix.size(), prefix) == 0 &&
+	       filename.compare(filename.size() - ext.size(), ext.size(), ext) == 0;
+}
+
+/* true if filename is a mapper output destined for reducer_id, in either format */
+inline bool is_intermediate_file_for(const std::string& filename, int reducer_id) {
+	const std::string stem = "_reducer_" + std::to_string(reducer_id);
+	for (auto format : {IntermediateFormat::BINARY, IntermediateFormat::TEXT}) {
+		const std::string suffix = stem + intermediate_file_ext(format);
+		if (filename.size() >= suffix.size() &&
+		    filename.compare(filename.size() - suffix.size(), suffix.size(), suffix) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+
+/* Writes one intermediate file. For BINARY the record count in the header is patched on close(). */
+class IntermediateWriter {
+
+	public:
+		/* compression applies to BINARY files only; TEXT stays plain for reading by eye */
+		bool open(const std::string& path, IntermediateFormat format, bool sorted, Compression compression = Compression::NONE);
+		void write(std::string_view key, std::string_view val);
+		bool close();
+
+	private:
+		void write_len_(uint64_t len);
+		void put_(const char* data, size_t n) { if (lz4_) lz4_->write(data, n); else out_.write(data, n); }
+
+		std::ofstream                   out_;
+		IntermediateFormat              format_ = IntermediateFormat::BINARY;
+		IntermediateFileHeader          header_{};
+		std::unique_ptr<Lz4FrameWriter> lz4_;
+};
+
+
+inline bool IntermediateWriter::open(const std::string& path, IntermediateFormat format, bool sorted, Compression compression) {
+	format_ = format;
+	out_.open(path, std::ios::binary | std::ios::trunc);
+	if (!out_.is_open()) {
+		std::cerr << "Failed to open file: " << path << std::endl;
+		return false;
+	}
+
+	if (format_ == IntermediateFormat::BINARY) {
+		std::memcpy(header_.magic, INTERMEDIATE_MAGIC, sizeof(header_.magic));
+		header_.version   = INTERMEDIATE_VERSION;
+		header_.flags     = (sorted ? INTERMEDIATE_FLAG_SORTED : 0) | (compression == Compression::LZ4 ? INTERMEDIATE_FLAG_LZ4 : 0);
+		header_.n_records = 0;
+		out_.write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+		if (compression == Compression::LZ4) lz4_ = std::make_unique<Lz4FrameWriter>(out_);
+	}
+	return static_cast<bool>(out_);
+}
+
+/* LEB128 varint: word-count style keys and values fit their length in one byte */
+inline void IntermediateWriter::write_len_(uint64_t len) {
+	char buf[10];
+	int n = 0;
+	do {
+		uint8_t byte = len & 0x7f;
+		len >>= 7;
+		buf[n++] = static_cast<char>(len ? (byte | 0x80) : byte);
+	} while (len);
+	put_(buf, n);
+}
+
+inline void IntermediateWriter::write(std::string_view key, std::string_view val) {
+	if (format_ == IntermediateFormat::TEXT) {
+		out_ << key << ", " << val << "\n";
+		return;
+	}
+
+	write_len_(key.size());
+	put_(key.data(), key.size());
+	write_len_(val.size());
+	put_(val.data(), val.size());
+	header_.n_records++;
+}
+
+inline bool IntermediateWriter::close() {
+	if (!out_.is_open()) return false;
+
+	if (lz4_) {
+		lz4_->finish();
+		lz4_.reset();
+	}
+	if (format_ == IntermediateFormat::BINARY) {
+		out_.seekp(0);
+		out_.write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+	}
+	out_.flush();
+	bool ok = static_cast<bool>(out_);
+	out_.close();
+	return ok;
+}
+
+
+/* Reads one intermediate file. The format is sniffed from the header, so reducers
+	can consume BINARY and TEXT mapper outputs side by side. */
+class IntermediateReader {
+
+	public:
+		bool open(const std::string& path);
+		/* false at the end of the file, or if it is cut short: check failed() before taking it as the end */
+		bool next(std::string& key, std::string& val);
+
+		/* A BINARY file ended before the record count in its header, or could not be decoded.
+			The file is truncated or corrupt, and the records after the failure are lost */
+		bool failed() const { return !error_.empty(); }
+		const std::string& error() const { return error_; }
+
+		IntermediateFormat format() const { return format_; }
+		uint64_t bytes_read() const { return bytes_read_; }
+		bool sorted() const { return format_ == IntermediateFormat::BINARY && (header_.flags & INTERMEDIATE_FLAG_SORTED); }
+
+	private:
+		bool read_str_(std::string& s);
+		int get_() { return lz4_ ? lz4_->get() : in_.get(); }
+		bool read_(char* dst, size_t n) {
+			return lz4_ ? lz4_->read(dst, n) == n : static_cast<bool>(in_.read(dst, static_cast<std::streamsize>(n)));
+		}
+
+		std::ifstream                   in_;
+		std::string                     path_;
+		std::string                     error_;
+		IntermediateFormat              format_ = IntermediateFormat::BINARY;
+		IntermediateFileHeader          header_{};
+		uint64_t                        n_read_ = 0;
+		uint64_t                        bytes_read_ = 0;  // bytes of the file consumed (compressed size if LZ4)
+		std::unique_ptr<Lz4FrameReader> lz4_;
+};
+
+
+inline bool IntermediateReader::open(const std::string& path) {
+	path_ = path;
+	in_.open(path, std::ios::binary);
+	if (!in_.is_open()) {
+		std::cerr << "[ERROR] Failed to open intermediate file: " << path << "\n";
+		return false;
+	}
+
+	in_.read(reinterpret_cast<char*>(&header_), sizeof(header_));
+	if (in_.gcount() == sizeof(header_) &&
+	    std::memcmp(header_.magic, INTERMEDIATE_MAGIC, sizeof(header_.magic)) == 0) {
+		if (header_.version != INTERMEDIATE_VERSION) {
+			std::cerr << "[ERROR] Unsupported intermediate file version " << header_.version
+			          << ": " << path << "\n";
+			return false;
+		}
+		format_ = IntermediateFormat::BINARY;
+		bytes_read_ = sizeof(header_);
+		if (header_.flags & INTERMEDIATE_FLAG_LZ4) lz4_ = std::make_unique<Lz4FrameReader>(in_);
+		return true;
+	}
+
+	// no header: legacy / debug text file, rewind and parse lines
+	format_ = IntermediateFormat::TEXT;
+	header_ = IntermediateFileHeader{};
+	in_.clear();
+	in_.seekg(0);
+	return true;
+}
+
+inline bool IntermediateReader::read_str_(std::string& s) {
+	uint64_t len = 0;
+	for (int shift = 0; ; shift += 7) {
+		int c = get_();
+		if (c == std::char_traits<char>::eof() || shift > 63) return false;
+		len |= static_cast<uint64_t>(c & 0x7f) << shift;
+		if (!lz4_) bytes_read_++;
+		if (!(c & 0x80)) break;
+	}
+	if (!lz4_) bytes_read_ += len;
+	s.resize(len);
+	return len == 0 || read_(&s[0], len);
+}
+
+inline bool IntermediateReader::next(std::string& key, std::string& val) {
+	if (format_ == IntermediateFormat::BINARY) {
+		if (n_read_ >= header_.n_records) return false;
+		if (!read_str_(key) || !read_str_(val)) {
+			// a frame that fails to decode (bad checksum, truncated block) is reported as such, not as an early end
+			error_ = path_ + (lz4_ && lz4_->failed() ? ": corrupt LZ4 frame at record " : ": truncated at record ")
+			         + std::to_string(n_read_) + " of " + std::to_string(header_.n_records);
+			return false;
+		}
+		n_read_++;
+		if (lz4_) bytes_read_ = sizeof(header_) + lz4_->bytes_consumed();
+		return true;
+	}
+
+	std::string line;
+	while (std::getline(in_, line)) {
+		bytes_read_ += line.size() + 1;
+		size_t delim = line.find(",");
+		if (delim == std::string::npos) continue;
+
+		key = line.substr(0, delim);
+		val = line.substr(delim + 1);
+		if (!val.empty() && val[0] == ' ') val.erase(0, 1);  // trim space
+		return true;
+	}
+	return false;
+}
+
+
+/* k-way merge over key-sorted intermediate files with a min-heap of run heads.
+	Yields one key group at a time, so memory is bounded by the largest group, not the inputs */
+class IntermediateMerger {
+
+	public:
+		IntermediateMerger() : heap_(HeadGreater{this}) {}
+
+		bool open(const std::vector<std::string>& paths);
+		/* false once every run is exhausted, or as soon as one of them fails (see failed()) */
+		bool next_group(std::string& key, std::vector<std::string>& values);
+
+		/* A run was truncated or corrupt; the merge output is incomplete and must not be used */
+		bool failed() const { return !error_.empty(); }
+		const std::string& error() const { return error_; }
+
+		uint64_t bytes_read() const { return bytes_read_; }  // summed over all sources
+
+	private:
+		struct Source {
+			IntermediateReader reader;
+			std::string        key;
+			std::string        val;
+		};
+
+		// min-heap on key; ties go to the earlier source so values keep run order
+		struct HeadGreater {
+			const IntermediateMerger* self;
+			bool operator()(size_t a, size_t b) const {
+				int c = self->sources_[a]->key.compare(self->sources_[b]->key);
+				return c != 0 ? c > 0 : a > b;
+			}
+		};
+
+		void advance_(size_t idx);
+
+		std::vector<std::unique_ptr<Source>>                            sources_;
+		std::priority_queue<size_t, std::vector<size_t>, HeadGreater>   heap_;
+		uint64_t                                                        bytes_read_ = 0;
+		std::string                                                     error_;
+};
+
+
+inline bool IntermediateMerger::open(const std::vector<std::string>& paths) {
+	for (const auto& path : paths) {
+		auto src = std::make_unique<Source>();
+		if (!src->reader.open(path)) return false;
+		bytes_read_ += src->reader.bytes_read();
+		sources_.push_back(std::move(src));
+		advance_(sources_.size() - 1);
+	}
+	return !failed();
+}
+
+inline void IntermediateMerger::advance_(size_t idx) {
+	Source& src = *sources_[idx];
+	uint64_t before = src.reader.bytes_read();
+	bool ok = src.reader.next(src.key, src.val);
+	bytes_read_ += src.reader.bytes_read() - before;
+	if (ok) {
+		heap_.push(idx);
+	} else if (src.reader.failed() && error_.empty()) {
+		error_ = src.reader.error();
+	}
+}
+
+inline bool IntermediateMerger::next_group(std::string& key, std::vector<std::string>& values) {
+	values.clear();
+	if (heap_.empty() || failed()) return false;
+
+	key = sources_[heap_.top()]->key;
+	while (!heap_.empty() && sources_[heap_.top()]->key == key) {
+		size_t idx = heap_.top();
+		heap_.pop();
+		values.push_back(std::move(sources_[idx]->val));
+		advance_(idx);
+	}
+	return true;
+}
+
+
+/* Merges sorted runs into a single sorted BINARY run, preserving every record; false (and no out_path)
+	if any run is truncated or corrupt */
+inline bool merge_runs_to_file(const std::vector<std::string>& paths, const std::string& out_path,
+		Compression compression = Compression::NONE) {
+	IntermediateMerger merger;
+	IntermediateWriter writer;
+	if (!merger.open(paths) || !writer.open(out_path, IntermediateFormat::BINARY, true, compression)) {
+		return false;
+	}
+
+	std::string key;
+	std::vector<std::string> values;
+	while (merger.next_group(key, values)) {
+		for (const auto& v : values) writer.write(key, v);
+	}
+	if (merger.failed()) {
+		std::cerr << "[ERROR] " << merger.error() << "\n";
+		writer.close();
+		std::remove(out_path.c_str());  // a partial merge must not pass for a complete run
+		return false;
+	}
+	return writer.close();
+}
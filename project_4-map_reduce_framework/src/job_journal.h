@@ -0,0 +1,165 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+
+/* Append-only log of a job's progress, kept by the master under the intermediate root so a restarted
+	master can pick the job up again. One record per line, written and fsync'd as soon as it is true:
+		plan <fingerprint>                    job inputs and settings the records below belong to
+		partitioning <hex>                    serialized masterworker::Partitioning sent to the mappers
+		map <mapper_id> <worker> <dir> <b0,b1,...>   accepted map output and its bytes per partition
+		reduce <reducer_id>                   output_<reducer_id> is complete
+		split_start / split_done              the split key merge began / was committed
+	A line torn by a crash is ignored on load, and so is every line after it */
+class JobJournal {
+
+	public:
+		struct MapRecord {
+			std::string           worker;
+			std::string           dir;
+			std::vector<uint64_t> partition_bytes;
+		};
+
+		struct State {
+			std::string               plan;
+			std::string               partitioning;   // serialized, empty if the job uses plain hashing
+			bool                      has_partitioning = false;
+			std::map<int, MapRecord>  maps;           // mapper id -> accepted output
+			std::set<int>             reducers;       // finished reducer ids
+			bool                      split_started = false;
+			bool                      split_done = false;
+		};
+
+		JobJournal() = default;
+		~JobJournal() { close(); }
+		JobJournal(const JobJournal&) = delete;
+		JobJournal& operator=(const JobJournal&) = delete;
+
+		/* Parses the journal at path into state; false if there is none */
+		static bool load(const std::string& path, State& state);
+
+		/* Opens path for appending; truncate starts a new journal */
+		bool open(const std::string& path, bool truncate);
+		/* Appends one record line; false if it could not be made durable */
+		bool append(const std::string& record);
+		void close();
+		bool is_open() const { return fd_ >= 0; }
+
+		static std::string to_hex(const std::string& bytes);
+		static bool from_hex(const std::string& hex, std::string& bytes);
+
+	private:
+		int fd_ = -1;
+};
+
+
+inline bool JobJournal::load(const std::string& path, State& state) {
+	std::ifstream in(path);
+	if (!in.is_open()) return false;
+
+	state = State{};
+	std::string line;
+	while (std::getline(in, line)) {
+		if (in.eof()) break;  // no trailing '\n': the last append was cut short
+		std::istringstream fields(line);
+		std::string type;
+		fields >> type;
+		if (type == "plan") {
+			fields >> state.plan;
+		} else if (type == "partitioning") {
+			std::string hex;
+			fields >> hex;
+			if (!from_hex(hex, state.partitioning)) break;
+			state.has_partitioning = true;
+		} else if (type == "map") {
+			int mapper_id = -1;
+			MapRecord rec;
+			std::string bytes;
+			if (!(fields >> mapper_id >> rec.worker >> rec.dir >> bytes) || mapper_id < 0) break;
+			std::istringstream list(bytes);
+			std::string b;
+			while (std::getline(list, b, ',')) rec.partition_bytes.push_back(std::strtoull(b.c_str(), nullptr, 10));
+			state.maps[mapper_id] = std::move(rec);
+		} else if (type == "reduce") {
+			int reducer_id = -1;
+			if (!(fields >> reducer_id) || reducer_id < 0) break;
+			state.reducers.insert(reducer_id);
+		} else if (type == "split_start") {
+			state.split_started = true;
+		} else if (type == "split_done") {
+			state.split_done = true;
+		} else {
+			break;
+		}
+	}
+	return true;
+}
+
+inline bool JobJournal::open(const std::string& path, bool truncate) {
+	close();
+	fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | (truncate ? O_TRUNC : 0), 0644);
+	if (fd_ < 0) {
+		std::cerr << "[ERROR] open(" << path << "): " << std::strerror(errno) << std::endl;
+		return false;
+	}
+	return true;
+}
+
+inline bool JobJournal::append(const std::string& record) {
+	if (fd_ < 0) return false;
+	const std::string line = record + "\n";
+	size_t done = 0;
+	while (done < line.size()) {
+		ssize_t n = ::write(fd_, line.data() + done, line.size() - done);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) {
+			std::cerr << "[ERROR] journal write: " << std::strerror(errno) << std::endl;
+			return false;
+		}
+		done += static_cast<size_t>(n);
+	}
+	return ::fsync(fd_) == 0;
+}
+
+inline void JobJournal::close() {
+	if (fd_ >= 0) ::close(fd_);
+	fd_ = -1;
+}
+
+inline std::string JobJournal::to_hex(const std::string& bytes) {
+	static constexpr char kDigits[] = "0123456789abcdef";
+	std::string hex;
+	hex.reserve(bytes.size() * 2);
+	for (unsigned char c : bytes) {
+		hex.push_back(kDigits[c >> 4]);
+		hex.push_back(kDigits[c & 0xf]);
+	}
+	return hex;
+}
+
+inline bool JobJournal::from_hex(const std::string& hex, std::string& bytes) {
+	auto nibble = [](char c) {
+		return c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+	};
+	if (hex.size() % 2) return false;
+	bytes.clear();
+	for (size_t i = 0; i < hex.size(); i += 2) {
+		int hi = nibble(hex[i]), lo = nibble(hex[i + 1]);
+		if (hi < 0 || lo < 0) return false;
+		bytes.push_back(static_cast<char>(hi << 4 | lo));
+	}
+	return true;
+}
@@ -0,0 +1,345 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <vector>
+
+
+/* Self-contained LZ4 codec: the block format plus the frame format around it, so compressed
+	intermediates and outputs can also be read with the stock `lz4 -d` tool. Only the parts this
+	project needs are implemented: greedy single-pass compression, independent 64 KB blocks, each
+	written with an xxh32 block checksum. The reader verifies the header and block checksums and
+	skips a content checksum if present */
+
+static constexpr uint32_t LZ4_FRAME_MAGIC      = 0x184D2204;
+static constexpr size_t   LZ4_BLOCK_BYTES      = 64 * 1024;  // frame BD = 4
+static constexpr uint32_t LZ4_BLOCK_UNCOMPRESSED = 0x80000000u;
+
+
+inline uint32_t lz4_read32_(const uint8_t* p) { uint32_t v; std::memcpy(&v, p, 4); return v; }
+
+inline void lz4_write32le_(std::ostream& out, uint32_t v) {
+	const char b[4] = {static_cast<char>(v), static_cast<char>(v >> 8), static_cast<char>(v >> 16), static_cast<char>(v >> 24)};
+	out.write(b, 4);
+}
+
+inline uint32_t lz4_load32le_(const uint8_t* p) {
+	return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+/* xxHash32, used by the frame header and block checksums */
+inline uint32_t xxh32(const uint8_t* p, size_t len, uint32_t seed) {
+	constexpr uint32_t P1 = 2654435761u, P2 = 2246822519u, P3 = 3266489917u, P4 = 668265263u, P5 = 374761393u;
+	auto rotl = [](uint32_t x, int r) { return (x << r) | (x >> (32 - r)); };
+	const uint8_t* end = p + len;
+	uint32_t h;
+	if (len >= 16) {
+		uint32_t v1 = seed + P1 + P2, v2 = seed + P2, v3 = seed, v4 = seed - P1;
+		for (; p + 16 <= end; p += 16) {
+			v1 = rotl(v1 + lz4_load32le_(p) * P2, 13) * P1;
+			v2 = rotl(v2 + lz4_load32le_(p + 4) * P2, 13) * P1;
+			v3 = rotl(v3 + lz4_load32le_(p + 8) * P2, 13) * P1;
+			v4 = rotl(v4 + lz4_load32le_(p + 12) * P2, 13) * P1;
+		}
+		h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+	} else {
+		h = seed + P5;
+	}
+	h += static_cast<uint32_t>(len);
+	for (; p + 4 <= end; p += 4) h = rotl(h + lz4_load32le_(p) * P3, 17) * P4;
+	for (; p < end; ++p) h = rotl(h + (*p) * P5, 11) * P1;
+	h ^= h >> 15; h *= P2;
+	h ^= h >> 13; h *= P3;
+	h ^= h >> 16;
+	return h;
+}
+
+
+inline size_t lz4_compress_bound(size_t n) { return n + n / 255 + 16; }
+
+/* Compresses n bytes (n <= LZ4_BLOCK_BYTES) into dst, which must hold lz4_compress_bound(n); returns the size */
+inline size_t lz4_compress_block(const char* src, size_t n, char* dst) {
+	const uint8_t* in = reinterpret_cast<const uint8_t*>(src);
+	uint8_t* op = reinterpret_cast<uint8_t*>(dst);
+	constexpr size_t MIN_MATCH = 4, MF_LIMIT = 12, LAST_LITERALS = 5;
+	constexpr int HASH_BITS = 12;
+
+	auto put_len = [&](size_t len) {
+		for (; len >= 255; len -= 255) *op++ = 255;
+		*op++ = static_cast<uint8_t>(len);
+	};
+	auto put_literals = [&](uint8_t* token, size_t from, size_t len) {
+		*token = static_cast<uint8_t>(std::min<size_t>(len, 15) << 4);
+		if (len >= 15) put_len(len - 15);
+		std::memcpy(op, in + from, len);
+		op += len;
+	};
+
+	size_t anchor = 0;
+	if (n > MF_LIMIT) {
+		uint32_t table[1 << HASH_BITS];
+		std::memset(table, 0xff, sizeof(table));
+		const size_t limit = n - MF_LIMIT;  // the last match starts at least 12 bytes before the end
+		size_t ip = 0;
+		while (ip < limit) {
+			const uint32_t seq = lz4_read32_(in + ip);
+			const uint32_t h = (seq * 2654435761u) >> (32 - HASH_BITS);
+			const size_t cand = table[h];
+			table[h] = static_cast<uint32_t>(ip);
+			if (cand >= ip || ip - cand > 65535 || lz4_read32_(in + cand) != seq) {
+				ip++;
+				continue;
+			}
+
+			size_t match = MIN_MATCH;
+			const size_t max_match = n - LAST_LITERALS - ip;  // the last 5 bytes stay literals
+			while (match < max_match && in[cand + match] == in[ip + match]) match++;
+
+			uint8_t* token = op++;
+			put_literals(token, anchor, ip - anchor);
+			const size_t offset = ip - cand;
+			*op++ = static_cast<uint8_t>(offset);
+			*op++ = static_cast<uint8_t>(offset >> 8);
+			const size_t ml = match - MIN_MATCH;
+			*token |= static_cast<uint8_t>(std::min<size_t>(ml, 15));
+			if (ml >= 15) put_len(ml - 15);
+
+			ip += match;
+			anchor = ip;
+		}
+	}
+	uint8_t* token = op++;
+	put_literals(token, anchor, n - anchor);
+	return static_cast<size_t>(op - reinterpret_cast<uint8_t*>(dst));
+}
+
+/* Decompresses one block into dst (capacity cap); returns the decoded size, or -1 if the block is corrupt */
+inline int64_t lz4_decompress_block(const char* src, size_t n, char* dst, size_t cap) {
+	const uint8_t* ip = reinterpret_cast<const uint8_t*>(src);
+	const uint8_t* const iend = ip + n;
+	uint8_t* op = reinterpret_cast<uint8_t*>(dst);
+	uint8_t* const ostart = op;
+	uint8_t* const oend = op + cap;
+
+	auto get_len = [&](size_t& len) {
+		uint8_t b;
+		do {
+			if (ip >= iend) return false;
+			b = *ip++;
+			len += b;
+		} while (b == 255);
+		return true;
+	};
+
+	while (ip < iend) {
+		const uint8_t token = *ip++;
+		size_t lit = token >> 4;
+		if (lit == 15 && !get_len(lit)) return -1;
+		if (lit > static_cast<size_t>(iend - ip) || lit > static_cast<size_t>(oend - op)) return -1;
+		std::memcpy(op, ip, lit);
+		ip += lit;
+		op += lit;
+		if (ip == iend) break;  // the last sequence has no match
+
+		if (iend - ip < 2) return -1;
+		const size_t offset = ip[0] | (ip[1] << 8);
+		ip += 2;
+		if (offset == 0 || offset > static_cast<size_t>(op - ostart)) return -1;
+		size_t match = token & 15;
+		if (match == 15 && !get_len(match)) return -1;
+		match += 4;
+		if (match > static_cast<size_t>(oend - op)) return -1;
+		const uint8_t* from = op - offset;
+		for (size_t i = 0; i < match; ++i) op[i] = from[i];  // may overlap: byte by byte
+		op += match;
+	}
+	return op - ostart;
+}
+
+
+/* Writes one LZ4 frame to out: header on construction, 64 KB blocks as data comes in, end mark on finish().
+	Every block carries an xxh32 checksum, so a reader can tell a corrupt block from valid data.
+	Frames can be appended back to back in one file; readers treat the concatenation as one stream */
+class Lz4FrameWriter {
+
+	public:
+		explicit Lz4FrameWriter(std::ostream& out) : out_(out) {
+			const uint8_t desc[2] = {0x70, 0x40};  // version 01, independent blocks, block checksums; 64 KB max block
+			lz4_write32le_(out_, LZ4_FRAME_MAGIC);
+			out_.write(reinterpret_cast<const char*>(desc), 2);
+			out_.put(static_cast<char>((xxh32(desc, 2, 0) >> 8) & 0xff));
+			block_.reserve(LZ4_BLOCK_BYTES);
+		}
+
+		void write(const char* data, size_t n) {
+			while (n > 0) {
+				const size_t take = std::min(n, LZ4_BLOCK_BYTES - block_.size());
+				block_.insert(block_.end(), data, data + take);
+				data += take;
+				n -= take;
+				if (block_.size() == LZ4_BLOCK_BYTES) flush_block_();
+			}
+		}
+
+		void finish() {
+			flush_block_();
+			lz4_write32le_(out_, 0);
+		}
+
+		uint64_t raw_bytes() const { return raw_bytes_; }
+
+	private:
+		void flush_block_() {
+			if (block_.empty()) return;
+			packed_.resize(lz4_compress_bound(block_.size()));
+			const size_t packed = lz4_compress_block(block_.data(), block_.size(), packed_.data());
+			if (packed < block_.size()) {
+				lz4_write32le_(out_, static_cast<uint32_t>(packed));
+				out_.write(packed_.data(), packed);
+				lz4_write32le_(out_, xxh32(reinterpret_cast<const uint8_t*>(packed_.data()), packed, 0));
+			} else {
+				// incompressible: store it as is
+				lz4_write32le_(out_, static_cast<uint32_t>(block_.size()) | LZ4_BLOCK_UNCOMPRESSED);
+				out_.write(block_.data(), block_.size());
+				lz4_write32le_(out_, xxh32(reinterpret_cast<const uint8_t*>(block_.data()), block_.size(), 0));
+			}
+			raw_bytes_ += block_.size();
+			block_.clear();
+		}
+
+		std::ostream&     out_;
+		std::vector<char> block_;
+		std::vector<char> packed_;
+		uint64_t          raw_bytes_ = 0;
+};
+
+
+/* Reads the decompressed bytes of one or more concatenated LZ4 frames from in */
+class Lz4FrameReader {
+
+	public:
+		explicit Lz4FrameReader(std::istream& in) : in_(in) {}
+
+		/* Copies up to n decoded bytes into dst; returns how many (0 at the end of the stream or on error) */
+		size_t read(char* dst, size_t n) {
+			size_t done = 0;
+			while (done < n) {
+				if (pos_ == block_.size() && !next_block_()) break;
+				const size_t take = std::min(n - done, block_.size() - pos_);
+				std::memcpy(dst + done, block_.data() + pos_, take);
+				pos_ += take;
+				done += take;
+			}
+			return done;
+		}
+
+		int get() {
+			if (pos_ == block_.size() && !next_block_()) return std::char_traits<char>::eof();
+			return static_cast<uint8_t>(block_[pos_++]);
+		}
+
+		bool failed() const { return failed_; }
+		uint64_t bytes_consumed() const { return consumed_; }  // compressed bytes read from in so far
+
+	private:
+		bool read_exact_(void* dst, size_t n) {
+			in_.read(static_cast<char*>(dst), static_cast<std::streamsize>(n));
+			consumed_ += static_cast<uint64_t>(in_.gcount());
+			return static_cast<size_t>(in_.gcount()) == n;
+		}
+
+		bool read32_(uint32_t& v) {
+			uint8_t b[4];
+			if (!read_exact_(b, 4)) return false;
+			v = lz4_load32le_(b);
+			return true;
+		}
+
+		bool fail_() { failed_ = true; return false; }
+
+		/* Parses a frame header; false at a clean end of stream */
+		bool next_frame_() {
+			uint32_t magic;
+			if (in_.peek() == std::char_traits<char>::eof()) return false;
+			if (!read32_(magic)) return fail_();
+			if ((magic & 0xFFFFFFF0u) == 0x184D2A50u) {  // skippable frame
+				uint32_t size;
+				if (!read32_(size)) return fail_();
+				in_.ignore(size);
+				consumed_ += size;
+				return next_frame_();
+			}
+			if (magic != LZ4_FRAME_MAGIC) return fail_();
+
+			uint8_t desc[2], hc;
+			if (!read_exact_(desc, 2)) return fail_();
+			if ((desc[0] >> 6) != 1 || (desc[0] & 0x01)) return fail_();  // version 01, no dictionary
+			block_checksum_   = desc[0] & 0x10;
+			content_checksum_ = desc[0] & 0x04;
+			const int bd = (desc[1] >> 4) & 0x7;
+			if (bd < 4) return fail_();
+			max_block_ = size_t(1) << (8 + 2 * bd);
+
+			uint8_t header[10] = {desc[0], desc[1]};
+			size_t header_len = 2;
+			if (desc[0] & 0x08) {
+				if (!read_exact_(header + 2, 8)) return fail_();
+				header_len += 8;
+			}
+			if (!read_exact_(&hc, 1)) return fail_();
+			if (hc != ((xxh32(header, header_len, 0) >> 8) & 0xff)) return fail_();
+			in_frame_ = true;
+			return true;
+		}
+
+		bool next_block_() {
+			for (;;) {
+				if (!in_frame_ && !next_frame_()) return false;
+
+				uint32_t size;
+				if (!read32_(size)) return fail_();
+				if (size == 0) {  // end mark
+					if (content_checksum_) { uint32_t c; if (!read32_(c)) return fail_(); }
+					in_frame_ = false;
+					continue;
+				}
+
+				const bool stored = size & LZ4_BLOCK_UNCOMPRESSED;
+				size &= ~LZ4_BLOCK_UNCOMPRESSED;
+				if (size > max_block_) return fail_();
+				packed_.resize(size);
+				if (!read_exact_(packed_.data(), size)) return fail_();
+				if (block_checksum_) {
+					uint32_t c;
+					if (!read32_(c)) return fail_();
+					if (c != xxh32(reinterpret_cast<const uint8_t*>(packed_.data()), size, 0)) return fail_();
+				}
+
+				if (stored) {
+					block_.swap(packed_);
+				} else {
+					block_.resize(max_block_);
+					const int64_t n = lz4_decompress_block(packed_.data(), size, block_.data(), block_.size());
+					if (n < 0) return fail_();
+					block_.resize(static_cast<size_t>(n));
+				}
+				pos_ = 0;
+				if (!block_.empty()) return true;
+			}
+		}
+
+		std::istream&     in_;
+		std::vector<char> block_;
+		std::vector<char> packed_;
+		size_t            pos_ = 0;
+		size_t            max_block_ = LZ4_BLOCK_BYTES;
+		bool              in_frame_ = false;
+		bool              block_checksum_ = false;
+		bool              content_checksum_ = false;
+		bool              failed_ = false;
+		uint64_t          consumed_ = 0;
+};
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <cstring>
+#include <iostream>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+/* Read-only mmap of an input file. Map tasks scan their [start, end) piece of it in place,
+	handing out lines as string_views into the mapping instead of copying through ifstream/getline */
+class MappedFile {
+
+	public:
+		MappedFile() = default;
+		~MappedFile() { close(); }
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		bool open(const std::string& path);
+		void close();
+
+		const char* data() const { return data_; }
+		size_t size() const { return size_; }
+
+		/* Calls f(std::string_view line) for every line starting in [start, end), without the '\n'.
+			If f returns bool, false stops the scan early */
+		template <typename F>
+		void for_each_line(size_t start, size_t end, F&& f) const;
+
+	private:
+		int    fd_   = -1;
+		char*  data_ = nullptr;
+		size_t size_ = 0;
+};
+
+
+inline bool MappedFile::open(const std::string& path) {
+	close();
+
+	fd_ = ::open(path.c_str(), O_RDONLY);
+	if (fd_ < 0) {
+		std::cerr << "[ERROR] open(" << path << "): " << std::strerror(errno) << std::endl;
+		return false;
+	}
+
+	struct stat st;
+	if (::fstat(fd_, &st) != 0) {
+		std::cerr << "[ERROR] fstat(" << path << "): " << std::strerror(errno) << std::endl;
+		close();
+		return false;
+	}
+	size_ = static_cast<size_t>(st.st_size);
+	if (size_ == 0) return true;  // nothing to map
+
+	void* p = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+	if (p == MAP_FAILED) {
+		std::cerr << "[ERROR] mmap(" << path << "): " << std::strerror(errno) << std::endl;
+		data_ = nullptr;
+		close();
+		return false;
+	}
+	data_ = static_cast<char*>(p);
+
+	// one forward pass: aggressive readahead, drop pages behind us
+	::madvise(data_, size_, MADV_SEQUENTIAL);
+	return true;
+}
+
+inline void MappedFile::close() {
+	if (data_) ::munmap(data_, size_);
+	if (fd_ >= 0) ::close(fd_);
+	data_ = nullptr;
+	size_ = 0;
+	fd_ = -1;
+}
+
+template <typename F>
+inline void MappedFile::for_each_line(size_t start, size_t end, F&& f) const {
+	if (end > size_) end = size_;
+
+	size_t pos = start;
+	while (pos < end) {
+		const char* nl = static_cast<const char*>(std::memchr(data_ + pos, '\n', size_ - pos));
+		size_t line_end = nl ? static_cast<size_t>(nl - data_) : size_;
+		if constexpr (std::is_same_v<std::invoke_result_t<F, std::string_view>, bool>) {
+			if (!f(std::string_view(data_ + pos, line_end - pos))) return;
+		} else {
+			f(std::string_view(data_ + pos, line_end - pos));
+		}
+		pos = line_end + 1;
+	}
+}
@@ -14,8 +14,21 @@ struct MapReduceSpec {
 	std::vector<std::string> input_files;
 	std::string output_dir;
 	int n_output_files;
-	int map_kilobytes;
+	int map_kilobytes;                           // 0 with map_kilobytes=auto
+	bool map_kilobytes_auto = false;             // size shards from the input size and worker count
+	int shard_waves_per_worker = 4;              // auto: aim for this many map tasks per worker
+	int min_shard_kilobytes = 0;                 // auto: bounds on the chosen shard size, 0 = overhead floor
+	int max_shard_kilobytes = 262144;
 	std::string user_id;
+	std::string intermediate_format = "binary"; // "binary" or "text" (debug)
+	int map_buffer_kilobytes = 65536;            // per-mapper memory budget before spilling, 0 = unbounded
+	std::string partitioner = "hash";            // "hash" or "range" (sampled, globally sorted output)
+	int hot_key_split = 0;                       // spread each sampled hot key over this many partitions, 0 = off
+	std::string intermediate_compression = "none"; // "none" or "lz4": binary intermediates, spills and merged runs
+	std::string output_compression = "none";       // "none" or "lz4": output_<n>.txt becomes output_<n>.txt.lz4
+	std::string reduce_mode = "sorted";            // "sorted" or "hash" (unordered output, partition held in memory)
+	int hash_reduce_max_megabytes = 1024;          // hash: table size per reducer before it falls back to sorted runs, 0 = unbounded
+	double slow_worker_probability = 0.15;         // chance a map task starts with the simulated 10 s stall, 0 for benchmarks
 };
 
 
@@ -56,9 +69,34 @@ inline bool read_mr_spec_from_config_file(const std::string& config_filename, Ma
 		} else if (key == "n_output_files") {
 			mr_spec.n_output_files = std::stoi(value);
 		} else if (key == "map_kilobytes") {
-			mr_spec.map_kilobytes = std::stoi(value);
+			mr_spec.map_kilobytes_auto = (value == "auto");
+			mr_spec.map_kilobytes = mr_spec.map_kilobytes_auto ? 0 : std::stoi(value);
+		} else if (key == "shard_waves_per_worker") {
+			mr_spec.shard_waves_per_worker = std::stoi(value);
+		} else if (key == "min_shard_kilobytes") {
+			mr_spec.min_shard_kilobytes = std::stoi(value);
+		} else if (key == "max_shard_kilobytes") {
+			mr_spec.max_shard_kilobytes = std::stoi(value);
 		} else if (key == "user_id") {
 			mr_spec.user_id = value;
+		} else if (key == "intermediate_format") {
+			mr_spec.intermediate_format = value;
+		} else if (key == "map_buffer_kilobytes") {
+			mr_spec.map_buffer_kilobytes = std::stoi(value);
+		} else if (key == "intermediate_compression") {
+			mr_spec.intermediate_compression = value;
+		} else if (key == "output_compression") {
+			mr_spec.output_compression = value;
+		} else if (key == "partitioner") {
+			mr_spec.partitioner = value;
+		} else if (key == "hot_key_split") {
+			mr_spec.hot_key_split = std::stoi(value);
+		} else if (key == "reduce_mode") {
+			mr_spec.reduce_mode = value;
+		} else if (key == "hash_reduce_max_megabytes") {
+			mr_spec.hash_reduce_max_megabytes = std::stoi(value);
+		} else if (key == "slow_worker_probability") {
+			mr_spec.slow_worker_probability = std::stod(value);
 		}
 	}
 
@@ -77,7 +115,12 @@ inline bool validate_mr_spec(const MapReduceSpec& mr_spec) {
 		return false;
 	}
 
-	if (mr_spec.map_kilobytes == 0){
+	if (mr_spec.map_kilobytes <= 0 && !mr_spec.map_kilobytes_auto){
+		return false;
+	}
+
+	if (mr_spec.map_kilobytes_auto && (mr_spec.shard_waves_per_worker <= 0 || mr_spec.min_shard_kilobytes < 0 ||
+	                                   mr_spec.min_shard_kilobytes > mr_spec.max_shard_kilobytes)){
 		return false;
 	}
 
@@ -89,6 +132,41 @@ inline bool validate_mr_spec(const MapReduceSpec& mr_spec) {
 		return false;
 	}
 
+	if (mr_spec.map_buffer_kilobytes < 0){
+		return false;
+	}
+
+	if (mr_spec.intermediate_format != "binary" && mr_spec.intermediate_format != "text"){
+		return false;
+	}
+
+	if (mr_spec.partitioner != "hash" && mr_spec.partitioner != "range"){
+		return false;
+	}
+
+	for (const auto* compression : {&mr_spec.intermediate_compression, &mr_spec.output_compression}) {
+		if (*compression != "none" && *compression != "lz4"){
+			return false;
+		}
+	}
+
+	if (mr_spec.reduce_mode != "sorted" && mr_spec.reduce_mode != "hash"){
+		return false;
+	}
+
+	if (mr_spec.hash_reduce_max_megabytes < 0){
+		return false;
+	}
+
+	if (mr_spec.slow_worker_probability < 0.0 || mr_spec.slow_worker_probability > 1.0){
+		return false;
+	}
+
+	// splitting only makes sense for an associative reducer, and across existing partitions
+	if (mr_spec.hot_key_split < 0 || mr_spec.hot_key_split > mr_spec.n_output_files){
+		return false;
+	}
+
 	// @TODO: think about more ways to validate
 	return true;
 }
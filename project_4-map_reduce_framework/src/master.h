@@ -5,6 +5,9 @@
 
 #include "mapreduce_spec.h"
 #include "file_shard.h"
+#include "partitioner.h"
+#include "job_journal.h"
+#include "intermediate_io.h"
 
 #include <iostream>
 #include <sstream>
@@ -12,16 +15,20 @@
 
 #include <atomic>
 #include <chrono>
-#include <condition_variable>
+#include <cctype>
 #include <thread>
 #include <mutex>
 #include <memory>
 
 #include <algorithm>
+#include <limits>
 #include <random>
 #include <vector>
 #include <deque>
+#include <map>
+#include <set>
 #include <unordered_map>
+#include <unordered_set>
 
 namespace fs = std::filesystem;
 
@@ -43,43 +50,208 @@ class Master {
             std::shared_ptr<grpc::Channel> channel;
             std::unique_ptr<masterworker::MasterWorker::Stub> stub;
             WorkerState state = WorkerState::IDLE;
+            int n_slots = 1;     // tasks the worker runs concurrently (advertised via getWorkerInfo)
+            int busy_slots = 0;
+            std::unordered_set<std::string> local_inputs;  // input files on the worker's own disk
         };
 
-        enum class Phase { MAP, REDUCE };
+        enum class Phase { MAP, REDUCE, SPLIT_MERGE };
         struct TaskMeta {
             int id; 
             Phase phase;
             std::atomic<bool> done{false};
-            std::chrono::steady_clock::time_point start;
-            std::mutex        mu;
             bool              accepted{false}; // first successful attempt wins
             std::string       accepted_dir; // winning intermediate dir (map only)
         };
 
+        // one dispatch of a task to a worker slot
+        struct Attempt {
+            int                                    tidx = -1;
+            int64_t                                id = 0;
+            std::chrono::steady_clock::time_point  start;
+            std::shared_ptr<grpc::ClientContext>   ctx;   // lets the master cancel the RPC of a dead worker
+            bool                                   speculative = false;  // backup copy of a still running task
+        };
+
+        // an intermediate dir and the worker whose local disk holds it; reducers fetch it from there
+        struct MapOutput {
+            std::string               dir;
+            std::string               worker;
+        };
+
+        // map outputs of one partition, as they are folded into pre-merged runs during the map phase
+        struct ShuffleState {
+            std::vector<MapOutput>    merged_dirs;     // dirs holding pre-merged runs
+            std::vector<MapOutput>    unmerged_dirs;   // accepted map dirs not yet folded into a run
+            bool                      merging = false; // a pre-merge job for this partition is queued or running
+            int                       n_jobs = 0;
+        };
+        struct PremergeJob {
+            int                       reducer_id;
+            int                       premerge_id;
+            std::vector<MapOutput>    input_dirs;
+        };
+
+        // task launches on a worker holding the task's data vs elsewhere, reported at the end of the job
+        struct LocalityStats {
+            int     local = 0;
+            int     remote = 0;
+        };
+
+        // speculative execution counters, reported at the end of the job
+        struct SpecStats {
+            int     launched = 0;    // backup attempts started
+            int     wins = 0;        // backups that finished before the original
+            int64_t wasted_ms = 0;   // runtime of attempts whose task had already been finished by another copy
+        };
+
+        // latest progress of an attempt, as reported by its worker's heartbeats
+        struct AttemptProgress {
+            uint64_t                               bytes_done = 0;
+            uint64_t                               bytes_total = 0;
+            uint64_t                               records = 0;
+            std::chrono::steady_clock::time_point  updated;   // last time bytes_done moved
+        };
+
+        // one in-flight RPC of run_phase; its address is the tag it completes with on the phase's queue
+        struct TaskCall {
+            enum class Kind { TASK, PREMERGE, CLEANUP };
+            Kind                                   kind = Kind::TASK;
+            int                                    widx = -1;
+            int                                    slot = -1;
+            Attempt                                attempt;   // TASK (attempt.id is also set for PREMERGE)
+            PremergeJob                            job;       // PREMERGE
+            std::string                            out_dir;   // dir the map or pre-merge task writes
+            std::shared_ptr<grpc::ClientContext>   ctx;
+            masterworker::WorkerResponse           response;
+            grpc::Status                           status;
+            std::unique_ptr<grpc::ClientAsyncResponseReader<masterworker::WorkerResponse>> rpc;
+        };
+
+        // heartbeat stream of one worker; all streams are driven by the heartbeat thread's completion queue
+        struct HeartbeatMonitor {
+            enum class Op { START, WRITE, WRITES_DONE, READ, FINISH };
+            struct Tag { HeartbeatMonitor* mon; Op op; };
+
+            int                                    widx = -1;
+            Tag                                    tags[5];
+            std::mutex                             ctx_mu;
+            std::unique_ptr<grpc::ClientContext>   ctx;       // current stream, cancelled on shutdown
+            std::unique_ptr<grpc::ClientAsyncReaderWriter<masterworker::HeartbeatRequest, masterworker::Heartbeat>> stream;
+            masterworker::HeartbeatRequest         request;
+            masterworker::Heartbeat                hb;
+            grpc::Status                           status;
+            bool                                   open = false;    // a stream is in flight
+            std::chrono::steady_clock::time_point  reconnect_at;    // while closed: next connection attempt
+            std::atomic<int64_t>                   last_seen_ms{0};
+            std::atomic<int64_t>                   rss_bytes{0};
+            std::atomic<int64_t>                   objects_created{0};   // the worker's task pool counters
+            std::atomic<int64_t>                   objects_reused{0};
+        };
+
         MapReduceSpec                      mr_spec_;
         const std::vector<FileShard>       file_shards_;
         std::vector<WorkerInfo>            workers_;
 
         std::vector<std::string>           intermediate_dirs_;
         std::mutex                         dirs_mu_;
-
-	    /* RPC functions */
-        bool doMapTask(int mapper_id, const FileShard &shard, WorkerInfo &w, std::string &out_dir);
-        bool doReduceTask(int reducer_id, WorkerInfo &w);
+        std::vector<ShuffleState>          shuffle_;   // per reducer; guarded by the map phase's lock
+
+        masterworker::Partitioning         partitioning_;     // sent with every map task
+        std::vector<std::string>           split_keys_;       // hot keys spread over several partitions
+        std::vector<int>                   split_key_homes_;  // output partition of each split key
+        std::vector<uint64_t>              partition_bytes_;  // intermediate bytes per partition, accepted maps only
+
+        std::vector<std::unique_ptr<HeartbeatMonitor>> monitors_;   // indexed like workers_
+        std::unique_ptr<grpc::CompletionQueue>         heartbeat_cq_;
+        std::thread                                    heartbeat_thread_;
+        std::unordered_map<int64_t, AttemptProgress>   progress_;   // attempt id -> progress
+        std::mutex                                     progress_mu_;
+        std::atomic<int64_t>                           next_attempt_id_{0};
+        std::atomic<bool>                              stopping_{false};
+        SpecStats                                      spec_stats_;
+        LocalityStats                                  locality_stats_;
+
+        JobJournal                                     journal_;
+        JobJournal::State                              done_;             // finished work: the journal's on resume, then this run's
+        bool                                           resumed_ = false;
+        bool                                           shuffle_lost_ = false;  // map outputs the reducers need are gone
+        bool                                           split_homes_lost_ = false;  // a split merge was partly committed
+
+	    /* RPC functions: each builds the request and starts the call on cq; the reply completes with &call as tag */
+        void doMapTask(int mapper_id, const FileShard &shard, WorkerInfo &w, TaskCall &call, grpc::CompletionQueue &cq);
+        void doReduceTask(int reducer_id, WorkerInfo &w, TaskCall &call, grpc::CompletionQueue &cq);
+        void doSplitMergeTask(WorkerInfo &w, TaskCall &call, grpc::CompletionQueue &cq);
+        void doPremergeTask(const PremergeJob &job, WorkerInfo &w, TaskCall &call, grpc::CompletionQueue &cq);
+        void doCleanup(const std::string &dir, WorkerInfo &w, TaskCall &call, grpc::CompletionQueue &cq);
+        /* true if a finished call and the worker both report success; logs the failure otherwise */
+        bool call_succeeded_(const TaskCall &call, const std::string &what, const std::string &who) const;
 
         /* Helper functions */
         void init_workers_();
+        void sample_partitioning_();
+        void print_partition_bytes_() const;
         bool run_phase(Phase p, int n_tasks);
+        /* Forgets accepted map outputs that can no longer be read, those in dirs or, with dirs empty, all of
+           worker's, so the next map round runs them again. Sets shuffle_lost_ if the shuffle used any of them */
+        void drop_map_outputs_(const std::string &worker, const std::unordered_set<std::string> &dirs);
+
+        void start_heartbeats_();
+        void stop_heartbeats_();
+        void heartbeat_loop_();
+        bool connect_heartbeat_(HeartbeatMonitor &mon);
+        void on_heartbeat_event_(HeartbeatMonitor::Tag &tag, bool ok);
+        static int64_t now_ms_();
+        static double percentile_(std::vector<double> v, double p);
+        void print_job_stats_() const;
+        std::vector<std::vector<int>> preferred_workers_(Phase phase, int n_tasks) const;
+        std::chrono::milliseconds task_deadline_(uint64_t input_bytes) const;
+        uint64_t task_input_bytes_(Phase phase, int tidx) const;
         
         std::string gen_random_id_() const;
+        static masterworker::CompressionType compression_type_(const std::string &name);
+        masterworker::ReduceMode reduce_mode_() const;
         void cleanup_output_dir_();
+        /* Reduce outputs: each attempt writes "<file>.<attempt_id>.tmp" files; the first successful
+           attempt is committed by renaming them over <file>, the others' are removed. On failure the
+           attempt's uncommitted files are removed, and partial is set if some were already renamed */
+        bool commit_reduce_(const std::string &attempt_files, int64_t attempt_id, bool &partial);
+        void discard_attempt_files_(const std::string &attempt_files);
+        void sweep_attempt_files_();
+        /* Split key side runs, once the split merge that read them is committed */
+        void remove_split_runs_();
         void cleanup_intermediate_();
 
+        /* Job journal: resume from ./intermediate/<user>/journal.log if it matches this job, else start a new one */
+        void open_journal_();
+        bool restore_from_journal_();
+        std::string plan_fingerprint_() const;
+        void record_(const std::string &record);
+        void remove_intermediate_(const std::vector<std::pair<int, std::string>> &targets);
+
         void print_mr_spec_() const;
         void print_file_shards_() const;
                 
         static constexpr const char* INTERMEDIATE_ROOT_DIR = "./intermediate";
-        static constexpr auto BASE_SPEC_MS = std::chrono::milliseconds(4000); // 4 seconds floor
+        static constexpr auto HEARTBEAT_INTERVAL = std::chrono::milliseconds(500);
+        static constexpr auto HEARTBEAT_TIMEOUT  = std::chrono::milliseconds(3000); // silent this long = dead
+        static constexpr auto EVENT_LOOP_TICK    = std::chrono::milliseconds(100);  // longest wait on a completion queue
+        static constexpr auto SPEC_INTERVAL      = std::chrono::milliseconds(500);  // straggler check period
+        static constexpr auto CLEANUP_DEADLINE   = std::chrono::seconds(2);
+        static constexpr auto TASK_DEADLINE_BASE = std::chrono::seconds(60);        // startup, fetches, slow-worker injection
+        static constexpr uint64_t TASK_DEADLINE_MIN_RATE = 1 << 20;                 // bytes/s; an attempt slower than this is hung
+        static constexpr auto SPEC_MIN_AGE       = std::chrono::milliseconds(1000); // too young to estimate a rate
+        static constexpr double SPEC_CAP_FRACTION    = 0.1;  // concurrent backups, as a fraction of all slots (at least 1)
+        static constexpr double SLOW_TASK_PERCENTILE = 0.25; // only tasks progressing slower than this are backed up
+        static constexpr double SLOW_NODE_PERCENTILE = 0.25; // workers below this throughput don't take backups
+        static constexpr size_t PREMERGE_MIN_RUNS = 4;        // map outputs of a partition worth one pre-merge job
+        static constexpr int    SAMPLE_SHARDS = 8;            // shards the partitioner pre-pass samples
+        static constexpr int64_t SAMPLE_BYTES = 1 << 20;      // input read per sampled shard
+        static constexpr int    SAMPLE_KEYS = 10000;          // keys kept per sampled shard
+        static constexpr double HOT_KEY_SHARE = 0.5;          // hot = over this fraction of a fair partition's records
+        static constexpr size_t MAX_HOT_KEYS = 16;
+        static constexpr auto LOCALITY_WAIT = std::chrono::milliseconds(1000); // delay scheduling: how long a task waits for a local slot
+        static constexpr int    MAX_MAP_ROUNDS = 4;           // map phases run for lost map outputs before the job fails
 };
 
 
@@ -96,28 +268,80 @@ inline bool Master::run() {
     print_mr_spec_();
     print_file_shards_();
 
+    open_journal_();
     cleanup_output_dir_();
 
     // Create one gRPC stub per worker (reused across all tasks)
     init_workers_();
+    start_heartbeats_();
+    if (!restore_from_journal_()) {
+        sample_partitioning_();
+        record_("plan " + plan_fingerprint_());
+        record_("partitioning " + JobJournal::to_hex(partitioning_.SerializeAsString()));
+    }
 
-    // MAP PHASE
-	  std::cout << "[MASTER] Starting map phase..." << std::endl;
-    if (!run_phase(Phase::MAP, static_cast<int>(file_shards_.size()))) return false;
-    std::cout << "[MASTER] Map phase completed" << std::endl;
+    // MAP and REDUCE PHASES: map outputs lost with a worker or a failed fetch send the job back to another
+    // map round, which runs only the lost maps; the reduce phase after it runs only the unfinished reducers.
+    // A split merge committed for only some of its home partitions sends those back to the reduce phase
+    // too, as a resumed job does once split_start is journaled
+    bool ok = true;
+    for (int round = 1; ; ++round) {
+        shuffle_lost_ = false;
+        split_homes_lost_ = false;
+        bool reduced = false;
+	      std::cout << "[MASTER] Starting map phase..." << std::endl;
+        ok = run_phase(Phase::MAP, static_cast<int>(file_shards_.size()));
+        if (ok && !shuffle_lost_) {
+            std::cout << "[MASTER] Map phase completed" << std::endl;
+            print_partition_bytes_();
+
+            std::cout << "[MASTER] Starting reduce phase..." << std::endl;
+            ok = run_phase(Phase::REDUCE, mr_spec_.n_output_files);
+            reduced = ok;
+            if (ok) std::cout << "[MASTER] Reduce phase completed" << std::endl;
+        }
+        if (reduced && !split_keys_.empty() && !done_.split_done) {
+            // split hot keys left one partial result per partition; reduce those once more
+            std::cout << "[MASTER] Merging " << split_keys_.size() << " split key(s)..." << std::endl;
+            record_("split_start");
+            ok = run_phase(Phase::SPLIT_MERGE, 1);
+            if (ok) {
+                record_("split_done");
+                done_.split_done = true;
+                remove_split_runs_();
+            }
+        }
+        if ((reduced && ok) || (!shuffle_lost_ && !split_homes_lost_)) break;
+        if (round == MAX_MAP_ROUNDS) {
+            std::cerr << "[MASTER] job still incomplete after " << round << " map round(s), giving up" << std::endl;
+            ok = false;
+            break;
+        }
+        if (split_homes_lost_) {
+            for (int home : split_key_homes_) done_.reducers.erase(home);
+            std::cout << "[MASTER] split merge partly committed, reducing its home partitions again" << std::endl;
+        } else {
+            std::cout << "[MASTER] map output(s) lost, running their map tasks again" << std::endl;
+        }
+    }
 
-    // REDUCE PHASE
-    std::cout << "[MASTER] Starting reduce phase..." << std::endl;
-    if (!run_phase(Phase::REDUCE, mr_spec_.n_output_files))            return false;
-    std::cout << "[MASTER] Reduce phase completed" << std::endl;
+    stop_heartbeats_();
+    print_job_stats_();
+    if (!ok) {
+        std::cerr << "[MASTER] job journal kept under " << INTERMEDIATE_ROOT_DIR << '/' << mr_spec_.user_id
+                  << ", rerun the job to resume it" << std::endl;
+        return false;
+    }
 
-    // clean up intermediate files
+    // clean up intermediate files, and temp outputs of attempts that never reported back
+    journal_.close();
+    sweep_attempt_files_();
     cleanup_intermediate_();
     return true;
 }
 
-inline bool Master::doMapTask(
-	int mapper_id, const FileShard& shard, WorkerInfo &w, std::string &out_dir
+inline void Master::doMapTask(
+	int mapper_id, const FileShard& shard, WorkerInfo &w, TaskCall &call, grpc::CompletionQueue &cq
 	) {
 	  std::cout << "[MASTER] Doing map task for mapper... " << mapper_id << std::endl;
 
@@ -126,43 +350,39 @@ inline bool Master::doMapTask(
     std::ostringstream oss;
     oss << INTERMEDIATE_ROOT_DIR << '/' << mr_spec_.user_id << '/' << mapper_id
         << '/' << rand_id;
-    out_dir = oss.str();
+    call.out_dir = oss.str();
 
-    std::cout << "[MASTER] mapper_id: " << mapper_id << ", intermediate_dir: " << out_dir << std::endl;
+    std::cout << "[MASTER] mapper_id: " << mapper_id << ", intermediate_dir: " << call.out_dir << std::endl;
 
     masterworker::MapRequest request;
     request.set_user_id(mr_spec_.user_id);
     request.set_mapper_id(mapper_id);
-    request.set_intermediate_file_dir(out_dir); 
+    request.set_intermediate_file_dir(call.out_dir); 
     request.set_n_output(mr_spec_.n_output_files);
+    request.set_intermediate_format(mr_spec_.intermediate_format == "text"
+                                        ? masterworker::INTERMEDIATE_TEXT
+                                        : masterworker::INTERMEDIATE_BINARY);
+    request.set_buffer_bytes(static_cast<int64_t>(mr_spec_.map_buffer_kilobytes) * 1024);
+    request.set_attempt_id(call.attempt.id);
+    *request.mutable_partitioning() = partitioning_;
+    request.set_compression(compression_type_(mr_spec_.intermediate_compression));
+    request.set_reduce_mode(reduce_mode_());
+    request.set_slow_probability(mr_spec_.slow_worker_probability);
 
     for (const auto& piece : shard.pieces) {
         auto* fp = request.add_file_pieces();
         fp->set_file_path(piece.filepath);
-        fp->set_start_offset(piece.start_offset);
-        fp->set_end_offset(piece.end_offset);
+        fp->set_start_offset(static_cast<int64_t>(piece.start_offset));
+        fp->set_end_offset(static_cast<int64_t>(piece.end_offset));
     }
 
-    masterworker::WorkerResponse response;
-    grpc::ClientContext ctx;
-    grpc::Status status = w.stub->assignMapTask(&ctx, request, &response);
-
-    if (!status.ok()) {
-        std::cerr << "[MASTER] Map RPC failure (mapper " << mapper_id << ") : "
-                  << status.error_message() << std::endl;
-        return false;
-    }
-    if (!response.success()) {
-        std::cerr << "[MASTER] Worker‑reported map failure (mapper " << mapper_id << ") : "
-                  << response.error() << std::endl;
-        return false;
-    }
-
-    return true;
+    call.rpc = w.stub->PrepareAsyncassignMapTask(call.ctx.get(), request, &cq);
+    call.rpc->StartCall();
+    call.rpc->Finish(&call.response, &call.status, &call);
 }
 
-inline bool Master::doReduceTask(
-	int reducer_id, WorkerInfo &w
+inline void Master::doReduceTask(
+	int reducer_id, WorkerInfo &w, TaskCall &call, grpc::CompletionQueue &cq
 	) {
 	std::cout << "[MASTER] Doing reduce task for reducer... " << reducer_id << std::endl;
 
@@ -170,167 +390,1100 @@ inline bool Master::doReduceTask(
     request.set_user_id(mr_spec_.user_id);
     request.set_reducer_id(reducer_id);
     request.set_output_dir(mr_spec_.output_dir);
+    request.set_attempt_id(call.attempt.id);
+    request.set_intermediate_compression(compression_type_(mr_spec_.intermediate_compression));
+    request.set_output_compression(compression_type_(mr_spec_.output_compression));
+    request.set_reduce_mode(reduce_mode_());
+    request.set_hash_max_bytes(static_cast<int64_t>(mr_spec_.hash_reduce_max_megabytes) << 20);
+
+    // pre-merged runs plus the map outputs that were not folded into one
+    const ShuffleState &sh = shuffle_[reducer_id];
+    for (const auto* outputs : {&sh.merged_dirs, &sh.unmerged_dirs}) {
+        for (const auto& out : *outputs) {
+            auto* input = request.add_inputs();
+            input->set_dir(out.dir);
+            input->set_worker(out.worker);
+        }
+    }
 
-    for (const auto& dir : intermediate_dirs_) {
-        request.add_intermediate_file_dirs(dir);
+    for (const auto& key : split_keys_) {
+        request.add_split_keys(key);
     }
 
     std::string s = "";
-    for (const auto& dir : request.intermediate_file_dirs()) {
-        s += dir + " ";
+    for (const auto& input : request.inputs()) {
+        s += input.worker() + ":" + input.dir() + " ";
     }
     std::cout << "[MASTER] reducer_id: " << reducer_id << ", intermediate dirs: " << s << std::endl;
 
-    masterworker::WorkerResponse response;
-    grpc::ClientContext ctx;
-    grpc::Status status = w.stub->assignReduceTask(&ctx, request, &response);
+    call.rpc = w.stub->PrepareAsyncassignReduceTask(call.ctx.get(), request, &cq);
+    call.rpc->StartCall();
+    call.rpc->Finish(&call.response, &call.status, &call);
+}
+
+inline void Master::doPremergeTask(
+	const PremergeJob &job, WorkerInfo &w, TaskCall &call, grpc::CompletionQueue &cq
+	) {
+    std::ostringstream oss;
+    oss << INTERMEDIATE_ROOT_DIR << '/' << mr_spec_.user_id << "/premerge/" << job.reducer_id
+        << '/' << gen_random_id_();
+    call.out_dir = oss.str();
+
+    std::cout << "[MASTER] Pre-merging " << job.input_dirs.size() << " map output(s) for reducer "
+              << job.reducer_id << " into " << call.out_dir << std::endl;
+
+    masterworker::PremergeRequest request;
+    request.set_reducer_id(job.reducer_id);
+    request.set_output_dir(call.out_dir);
+    request.set_premerge_id(job.premerge_id);
+    request.set_attempt_id(call.attempt.id);
+    request.set_compression(compression_type_(mr_spec_.intermediate_compression));
+    for (const auto& out : job.input_dirs) {
+        auto* input = request.add_inputs();
+        input->set_dir(out.dir);
+        input->set_worker(out.worker);
+    }
+
+    call.rpc = w.stub->PrepareAsyncpremergeReduceInputs(call.ctx.get(), request, &cq);
+    call.rpc->StartCall();
+    call.rpc->Finish(&call.response, &call.status, &call);
+}
+
+inline void Master::doSplitMergeTask(WorkerInfo &w, TaskCall &call, grpc::CompletionQueue &cq) {
+    masterworker::ReduceRequest request;
+    request.set_user_id(mr_spec_.user_id);
+    request.set_output_dir(mr_spec_.output_dir);
+    request.set_attempt_id(call.attempt.id);
+    request.set_merge_split_keys(true);
+    request.set_reduce_mode(reduce_mode_());
+    request.set_output_compression(compression_type_(mr_spec_.output_compression));
+    for (size_t i = 0; i < split_keys_.size(); ++i) {
+        request.add_split_keys(split_keys_[i]);
+        request.add_split_key_homes(split_key_homes_[i]);
+    }
+
+    call.rpc = w.stub->PrepareAsyncassignReduceTask(call.ctx.get(), request, &cq);
+    call.rpc->StartCall();
+    call.rpc->Finish(&call.response, &call.status, &call);
+}
+
+/* Best effort: the worker is given CLEANUP_DEADLINE to remove dir from its local disk */
+inline void Master::doCleanup(const std::string &dir, WorkerInfo &w, TaskCall &call, grpc::CompletionQueue &cq) {
+    call.kind = TaskCall::Kind::CLEANUP;
+    call.out_dir = dir;
+    call.ctx = std::make_shared<grpc::ClientContext>();
+    call.ctx->set_deadline(std::chrono::system_clock::now() + CLEANUP_DEADLINE);
+
+    masterworker::CleanupRequest request;
+    request.set_dir(dir);
+    call.rpc = w.stub->PrepareAsynccleanupIntermediate(call.ctx.get(), request, &cq);
+    call.rpc->StartCall();
+    call.rpc->Finish(&call.response, &call.status, &call);
+}
 
-    if (!status.ok()) {
-        std::cerr << "[MASTER] Reduce RPC failure (reducer " << reducer_id << ") : "
-                  << status.error_message() << std::endl;
+/* what: "map", "reduce", ... as it appears in the log; who: e.g. " (mapper 3)" */
+inline bool Master::call_succeeded_(const TaskCall &call, const std::string &what, const std::string &who) const {
+    if (call.kind == TaskCall::Kind::CLEANUP) {
+        if (call.status.ok() && call.response.success()) return true;
+        std::cerr << "[MASTER] WARNING: worker " << mr_spec_.worker_ipaddr_ports[call.widx] << " failed to remove '"
+                  << call.out_dir << "' : " << (call.status.ok() ? call.response.error() : call.status.error_message()) << '\n';
         return false;
     }
-    if (!response.success()) {
-        std::cerr << "[MASTER] Worker‑reported reduce failure (reducer " << reducer_id << ") : "
-                  << response.error() << std::endl;
+    if (!call.status.ok()) {
+        std::string name = what;
+        name[0] = static_cast<char>(std::toupper(static_cast<unsigned char>(name[0])));
+        std::cerr << "[MASTER] " << name << " RPC failure" << who << " : "
+                  << call.status.error_message() << std::endl;
+        return false;
+    }
+    if (!call.response.success()) {
+        std::cerr << "[MASTER] Worker‑reported " << what << " failure" << who << " : "
+                  << call.response.error() << std::endl;
         return false;
     }
-
     return true;
 }
 
+/* Partitioner pre-pass, only for partitioner=range or hot_key_split > 1: the mapper runs over the head of
+	a few evenly spaced shards and the sampled keys give the range boundaries and the hot keys */
+inline void Master::sample_partitioning_() {
+    const int n_output = mr_spec_.n_output_files;
+    partitioning_.Clear();
+    split_keys_.clear();
+    split_key_homes_.clear();
+    if (mr_spec_.partitioner != "range" && mr_spec_.hot_key_split <= 1) return;
+
+    std::vector<int> live;
+    for (size_t i = 0; i < workers_.size(); ++i) if (workers_[i].state != WorkerState::DEAD) live.push_back((int)i);
+    const int n_samples = std::min<int>(SAMPLE_SHARDS, static_cast<int>(file_shards_.size()));
+    if (live.empty() || n_samples == 0) return;
+
+    // every sample request is started at once on one completion queue, as in init_workers_
+    struct SampleCall {
+        grpc::ClientContext                    ctx;
+        masterworker::SampleResponse           response;
+        grpc::Status                           status;
+        std::unique_ptr<grpc::ClientAsyncResponseReader<masterworker::SampleResponse>> rpc;
+    };
+    grpc::CompletionQueue cq;
+    std::vector<std::unique_ptr<SampleCall>> calls;
+    for (int k = 0; k < n_samples; ++k) {
+        const FileShard &shard = file_shards_[static_cast<size_t>(k) * file_shards_.size() / n_samples];
+        masterworker::SampleRequest request;
+        request.set_user_id(mr_spec_.user_id);
+        request.set_max_bytes(SAMPLE_BYTES);
+        request.set_max_keys(SAMPLE_KEYS);
+        for (const auto &piece : shard.pieces) {
+            auto *fp = request.add_file_pieces();
+            fp->set_file_path(piece.filepath);
+            fp->set_start_offset(static_cast<int64_t>(piece.start_offset));
+            fp->set_end_offset(static_cast<int64_t>(piece.end_offset));
+        }
+        auto call = std::make_unique<SampleCall>();
+        call->ctx.set_deadline(std::chrono::system_clock::now() + std::chrono::seconds(10));
+        call->rpc = workers_[live[k % live.size()]].stub->PrepareAsyncsampleKeys(&call->ctx, request, &cq);
+        call->rpc->StartCall();
+        call->rpc->Finish(&call->response, &call->status, call.get());
+        calls.push_back(std::move(call));
+    }
+
+    void *tag; bool ok;
+    for (size_t n = 0; n < calls.size() && cq.Next(&tag, &ok); ++n) {}
+    std::vector<std::vector<std::string>> samples(n_samples);
+    for (int k = 0; k < n_samples; ++k)
+        if (calls[k]->status.ok()) samples[k].assign(calls[k]->response.keys().begin(), calls[k]->response.keys().end());
+    cq.Shutdown();
+    while (cq.Next(&tag, &ok)) {}
+
+    std::vector<std::string> keys;
+    for (auto &sample : samples) keys.insert(keys.end(), sample.begin(), sample.end());
+    std::cout << "[MASTER] partitioner: sampled " << keys.size() << " key(s) from " << n_samples << " shard(s)" << std::endl;
+    if (keys.empty()) {
+        std::cerr << "[MASTER] WARNING: no key samples, falling back to hash partitioning" << std::endl;
+        return;
+    }
+
+    std::vector<std::string> hot;
+    if (mr_spec_.hot_key_split > 1) {
+        hot = hot_keys_from_sample(keys, HOT_KEY_SHARE / n_output);
+        if (hot.size() > MAX_HOT_KEYS) hot.resize(MAX_HOT_KEYS);
+        // boundaries from the remaining keys, so a hot key doesn't swallow whole ranges
+        std::unordered_set<std::string> hot_set(hot.begin(), hot.end());
+        keys.erase(std::remove_if(keys.begin(), keys.end(), [&](const std::string &k){ return hot_set.count(k) > 0; }),
+                   keys.end());
+    }
+
+    std::shared_ptr<Partitioner> base = std::make_shared<HashPartitioner>(n_output);
+    if (mr_spec_.partitioner == "range") {
+        std::vector<std::string> boundaries = range_boundaries_from_sample(keys, n_output);
+        partitioning_.set_type(masterworker::PARTITIONER_RANGE);
+        for (const auto &b : boundaries) partitioning_.add_range_boundaries(b);
+        std::cout << "[MASTER] partitioner: " << boundaries.size() << " range boundaries" << std::endl;
+        base = std::make_shared<RangePartitioner>(std::move(boundaries));
+    }
+
+    for (const auto &key : hot) {
+        const int home = base->partition(key);
+        auto *hk = partitioning_.add_hot_keys();
+        hk->set_key(key);
+        for (int j = 0; j < mr_spec_.hot_key_split; ++j) hk->add_partitions((home + j) % n_output);
+        split_keys_.push_back(key);
+        split_key_homes_.push_back(home);
+        std::cout << "[MASTER] partitioner: hot key '" << key << "' split over " << mr_spec_.hot_key_split
+                  << " partitions from " << home << std::endl;
+    }
+}
+
+inline void Master::print_partition_bytes_() const {
+    if (partition_bytes_.empty()) return;
+    uint64_t total = 0, largest = 0;
+    std::cout << "[MASTER] intermediate bytes per partition:";
+    for (size_t r = 0; r < partition_bytes_.size(); ++r) {
+        std::cout << (r % 8 == 0 ? "\n    " : " ") << r << ":" << partition_bytes_[r];
+        total += partition_bytes_[r];
+        largest = std::max(largest, partition_bytes_[r]);
+    }
+    const double mean = double(total) / partition_bytes_.size();
+    std::cout << "\n[MASTER] largest partition is " << (mean > 0 ? largest / mean : 0.0) << "x the mean" << std::endl;
+}
+
+/* Asks every worker for its slot count and local inputs at once; an unreachable worker keeps 1 slot
+	and is handled by the heartbeat */
 inline void Master::init_workers_() {
+    struct InfoCall {
+        grpc::ClientContext                    ctx;
+        masterworker::WorkerInfoResponse       response;
+        grpc::Status                           status;
+        std::unique_ptr<grpc::ClientAsyncResponseReader<masterworker::WorkerInfoResponse>> rpc;
+    };
+
+    masterworker::WorkerInfoRequest request;
+    for (const auto &file : mr_spec_.input_files) request.add_input_files(file);
+
+    // a resumed job also asks each worker whether the map outputs the journal places on it survived
+    std::unordered_map<std::string, std::vector<int>> recovered_on;   // worker -> mapper ids, in request order
+    for (const auto &[mapper_id, rec] : done_.maps) recovered_on[rec.worker].push_back(mapper_id);
+
+    grpc::CompletionQueue cq;
+    std::vector<std::unique_ptr<InfoCall>> calls;
     for (const auto &addr : mr_spec_.worker_ipaddr_ports) {
         WorkerInfo w;
+        masterworker::WorkerInfoRequest worker_request = request;
+        for (int mapper_id : recovered_on[addr]) worker_request.add_map_output_dirs(done_.maps[mapper_id].dir);
         w.channel = grpc::CreateChannel(addr, grpc::InsecureChannelCredentials());
         w.stub    = masterworker::MasterWorker::NewStub(w.channel);
+
+        auto call = std::make_unique<InfoCall>();
+        call->ctx.set_deadline(std::chrono::system_clock::now() + std::chrono::seconds(2));
+        call->rpc = w.stub->PrepareAsyncgetWorkerInfo(&call->ctx, worker_request, &cq);
+        call->rpc->StartCall();
+        call->rpc->Finish(&call->response, &call->status, call.get());
+        calls.push_back(std::move(call));
         workers_.push_back(std::move(w));
     }
+
+    void *tag; bool ok;
+    for (size_t n = 0; n < calls.size() && cq.Next(&tag, &ok); ++n) {}
+
+    for (size_t i = 0; i < workers_.size(); ++i) {
+        WorkerInfo &w = workers_[i];
+        const InfoCall &call = *calls[i];
+        if (call.status.ok() && call.response.n_slots() > 0) {
+            w.n_slots = call.response.n_slots();
+            w.local_inputs.insert(call.response.local_input_files().begin(), call.response.local_input_files().end());
+        }
+        std::cout << "[MASTER] worker " << mr_spec_.worker_ipaddr_ports[i] << ": " << w.n_slots << " slot(s), "
+                  << w.local_inputs.size() << "/" << mr_spec_.input_files.size() << " input file(s) local" << std::endl;
+
+        // a map output survives only if all of its partition files are still there
+        auto &mine = recovered_on[mr_spec_.worker_ipaddr_ports[i]];
+        for (size_t k = 0; k < mine.size(); ++k) {
+            const bool intact = call.status.ok() && (int)k < call.response.map_output_files_size() &&
+                                call.response.map_output_files((int)k) == mr_spec_.n_output_files;
+            if (intact) continue;
+            std::cout << "[MASTER] resume: map output of mapper " << mine[k] << " is gone, it runs again" << std::endl;
+            done_.maps.erase(mine[k]);
+        }
+        mine.clear();
+    }
+    // outputs placed on workers that are no longer part of the job
+    for (const auto &[addr, ids] : recovered_on)
+        for (int mapper_id : ids) done_.maps.erase(mapper_id);
+    cq.Shutdown();
+    while (cq.Next(&tag, &ok)) {}
 }
 
+/* One thread drives the phase: every task, pre-merge and cleanup RPC is started asynchronously on one
+	completion queue, and the loop below reacts to replies, heartbeat timeouts and the speculation timer
+	in turn. No per-slot threads, so the master's thread count does not grow with the workers */
 inline bool Master::run_phase(Phase phase, int n_tasks) {
-  std::cout << "[MASTER] " << (phase==Phase::MAP?"MAP":"REDUCE") << " phase, tasks=" << n_tasks << std::endl;
+  const char *phase_name = phase==Phase::MAP ? "MAP" : phase==Phase::REDUCE ? "REDUCE" : "SPLIT_MERGE";
+  const auto phase_start = std::chrono::steady_clock::now();
+  std::cout << "[MASTER] " << phase_name << " phase, tasks=" << n_tasks << std::endl;
 
   std::vector<TaskMeta> tasks(n_tasks);
   for (int i=0;i<n_tasks;++i){ tasks[i].id=i; tasks[i].phase=phase; }
 
-  std::deque<int> pending; for(int i=0;i<n_tasks;++i) pending.push_back(i);
-  std::unordered_map<int,int> running;
-  std::mutex m; std::condition_variable cv;
-  std::atomic<int> remaining=n_tasks; std::atomic<bool> phase_ok{true};
+  // every slot is free at a phase barrier; only a worker found dead stays out
+  for (auto &w : workers_) {
+    if (w.state == WorkerState::DEAD) continue;
+    w.state = WorkerState::IDLE;
+    w.busy_slots = 0;
+  }
 
-  auto worker_fn = [&](int widx){
-    WorkerInfo &w = workers_[widx];
-    while(true){
-      int tidx=-1;
-      {
-        std::unique_lock<std::mutex> lk(m);
-        cv.wait(lk,[&]{return !pending.empty()||remaining==0||w.state==WorkerState::DEAD;});
-        if(w.state==WorkerState::DEAD || (pending.empty() && remaining==0))
-          return;
-        if(pending.empty()) 
-          continue;
-        tidx=pending.front(); pending.pop_front();
-        w.state=WorkerState::BUSY; 
-        running[widx]=tidx;
-        tasks[tidx].start=std::chrono::steady_clock::now();
+  // delay scheduling: a task waits up to LOCALITY_WAIT (since it was queued) for a slot on a worker
+  // holding its data, then runs wherever a slot is free
+  const std::vector<std::vector<int>> preferred = preferred_workers_(phase, n_tasks);
+  std::vector<std::chrono::steady_clock::time_point> queued_at(n_tasks);
+  LocalityStats locality;
+
+  // queued tasks, indexed so a free slot finds its task without scanning the queue: all of them in queue
+  // order, by preferred worker, and the ones no live worker is preferred for. Entries of tasks taken
+  // through another index (or done) are dropped when they reach a front
+  std::deque<int> pending;
+  std::vector<std::deque<int>> pending_on(workers_.size());
+  std::deque<int> pending_anywhere;
+  std::vector<char> queued(n_tasks, 0);
+  auto enqueue = [&](int tidx){
+    queued_at[tidx]=std::chrono::steady_clock::now();
+    queued[tidx]=1;
+    pending.push_back(tidx);
+    bool held = false;
+    for (int p : preferred[tidx]) {
+      pending_on[p].push_back(tidx);
+      held = held || workers_[p].state != WorkerState::DEAD;
+    }
+    if (!held) pending_anywhere.push_back(tidx);
+  };
+  for(int i=0;i<n_tasks;++i) enqueue(i);
+  std::deque<int> spec_pending;                 // backups, only handed to fast workers
+  std::map<std::pair<int,int>,Attempt> running; // (worker, slot) -> in-flight attempt
+  std::unordered_set<int64_t> cancelled;        // attempts cancelled because another copy of their task won
+  int remaining=n_tasks; bool phase_ok=true;
+
+  grpc::CompletionQueue cq;
+  std::unordered_map<TaskCall*,std::unique_ptr<TaskCall>> calls;  // in flight, keyed by their tag
+  std::vector<std::vector<bool>> slot_busy(workers_.size());
+  for (size_t i=0;i<workers_.size();++i) slot_busy[i].assign(workers_[i].n_slots, false);
+  int max_slots = 0;
+  for (const auto &w : workers_) max_slots = std::max(max_slots, w.n_slots);
+
+  // per-worker throughput of finished attempts in this phase (bytes, ms), used to pick backup hosts
+  std::vector<std::pair<uint64_t,int64_t>> worker_tput(workers_.size(), {0, 0});
+  // SLOW_NODE_PERCENTILE of those rates; only recomputed after worker_tput changes, not per slot checked
+  double slow_node_rate = 0.0;
+  bool slow_node_stale = false;
+  int total_slots = 0;
+  for (const auto &w : workers_) if (w.state!=WorkerState::DEAD) total_slots += w.n_slots;
+  const int spec_cap = std::max(1, static_cast<int>(total_slots * SPEC_CAP_FRACTION));
+
+  // map phase only: slots with no map task left fold finished map outputs into one run per partition,
+  // overlapping the shuffle with the map tail. Reducers still start after the phase barrier
+  std::deque<PremergeJob> premerge_jobs;
+  std::map<std::pair<int,int>,std::shared_ptr<grpc::ClientContext>> premerging; // (worker, slot) -> in-flight job
+  if (phase==Phase::MAP) {
+    shuffle_.assign(mr_spec_.n_output_files, ShuffleState{});
+    partition_bytes_.assign(mr_spec_.n_output_files, 0);
+  }
+
+  auto attempts_of = [&](int tidx){
+    int n=0; for (const auto& [slot,a]:running) if (a.tidx==tidx) ++n; return n;
+  };
+  auto running_on = [&](int widx, int tidx){
+    for (const auto& [slot,a]:running) if (slot.first==widx && a.tidx==tidx) return true;
+    return false;
+  };
+  auto backups_in_flight = [&]{
+    int n=0;
+    for (const auto& [slot,a]:running) if (a.speculative && !tasks[a.tidx].done.load()) ++n;
+    for (int tidx:spec_pending) if (!tasks[tidx].done.load()) ++n;
+    return n;
+  };
+  // a worker with no finished attempt yet is given the benefit of the doubt
+  auto is_fast_worker = [&](int widx){
+    if (worker_tput[widx].second <= 0) return true;
+    if (slow_node_stale) {
+      std::vector<double> rates;
+      for (const auto& [bytes,ms]:worker_tput) if (ms>0) rates.push_back(double(bytes)/ms);
+      slow_node_rate = percentile_(rates, SLOW_NODE_PERCENTILE);
+      slow_node_stale = false;
+    }
+    return double(worker_tput[widx].first)/worker_tput[widx].second >= slow_node_rate;
+  };
+  auto is_local = [&](int widx, int tidx){
+    return std::find(preferred[tidx].begin(), preferred[tidx].end(), widx) != preferred[tidx].end();
+  };
+  // a non-local worker may take the task once it has waited long enough or no holder of its data is alive
+  auto may_run_remote = [&](int tidx){
+    if (std::chrono::steady_clock::now() - queued_at[tidx] >= LOCALITY_WAIT) return true;
+    for (int p : preferred[tidx]) if (workers_[p].state != WorkerState::DEAD) return false;
+    return true;
+  };
+  // first queued task local to widx, else one held by no live worker, else the oldest if it has waited
+  // long enough (the queue is in queue-time order, so no later one has); -1 if none. take removes it
+  auto next_pending = [&](int widx, bool take){
+    for (auto *q : {&pending_on[widx], &pending_anywhere, &pending}) {
+      while (!q->empty() && (!queued[q->front()] || tasks[q->front()].done.load())) q->pop_front();
+      if (q->empty() || (q == &pending && !may_run_remote(q->front()))) continue;
+      const int tidx = q->front();
+      if (take) {
+        q->pop_front();
+        queued[tidx] = 0;
       }
-      bool ok=false; std::string tmp_dir;
-      if (phase==Phase::MAP)  ok = doMapTask(tasks[tidx].id, file_shards_[tidx], w, tmp_dir);
-      else                    ok = doReduceTask(tasks[tidx].id, w);
+      return tidx;
+    }
+    return -1;
+  };
+  auto pick_pending = [&](int widx){ return next_pending(widx, true); };
+  // next task for this worker: originals first, then a backup it isn't already running
+  auto take_task = [&](int widx, bool &speculative){
+    int tidx = pick_pending(widx);
+    if (tidx >= 0) {
+      speculative=false;
+      // only tasks some worker holds data for count towards the hit rate
+      if (!preferred[tidx].empty()) { if (is_local(widx, tidx)) ++locality.local; else ++locality.remote; }
+      return tidx;
+    }
+    if (!is_fast_worker(widx)) return -1;
+    for (auto it=spec_pending.begin(); it!=spec_pending.end();) {
+      int tidx=*it;
+      if (tasks[tidx].done.load()) { it=spec_pending.erase(it); continue; }
+      if (running_on(widx, tidx)) { ++it; continue; }
+      spec_pending.erase(it);
+      speculative=true;
+      return tidx;
+    }
+    return -1;
+  };
+  auto queue_premerge = [&](int r){
+    ShuffleState &sh = shuffle_[r];
+    // hash mode map outputs are unsorted runs, which premerge cannot merge
+    if (mr_spec_.reduce_mode == "hash") return;
+    if (sh.merging || sh.unmerged_dirs.size() < PREMERGE_MIN_RUNS) return;
+    premerge_jobs.push_back({r, sh.n_jobs++, std::move(sh.unmerged_dirs)});
+    sh.unmerged_dirs.clear();
+    sh.merging = true;
+  };
+  // records an accepted map output: the reducers of every partition will read it
+  auto accept_map = [&](int tidx, const std::string &dir, const std::string &worker, const std::vector<uint64_t> &part_bytes){
+    tasks[tidx].accepted = true;
+    tasks[tidx].accepted_dir = dir;
+    {
+        std::lock_guard dirlk(dirs_mu_);
+        intermediate_dirs_.push_back(dir);
+    }
+    for (int r=0; r<(int)shuffle_.size(); ++r) {
+        shuffle_[r].unmerged_dirs.push_back({dir, worker});
+        queue_premerge(r);
+    }
+    for (size_t r=0; r<part_bytes.size() && r<partition_bytes_.size(); ++r)
+        partition_bytes_[r] += part_bytes[r];
+  };
+  auto can_take = [&](int widx){
+    if (!premerge_jobs.empty()) return true;
+    if (next_pending(widx, false) >= 0) return true;
+    if (spec_pending.empty() || !is_fast_worker(widx)) return false;
+    for (int tidx:spec_pending) if (tasks[tidx].done.load() || !running_on(widx, tidx)) return true;
+    return false;
+  };
 
-      {
-          std::lock_guard lk(m);
-          running.erase(widx);
-          if (!ok) {
-              w.state = WorkerState::DEAD;                 // mark dead; heartbeat thread will later attempt revive
-              if (!tasks[tidx].done.load()) pending.push_back(tidx); // requeue task
-          } else {
-              w.state = WorkerState::IDLE;
-              if (phase==Phase::MAP) {
-                  std::lock_guard tl(tasks[tidx].mu);
-                  if (!tasks[tidx].accepted) {
-                      tasks[tidx].accepted = true;
-                      tasks[tidx].accepted_dir = tmp_dir;
-                      {
-                          std::lock_guard dirlk(dirs_mu_);
-                          intermediate_dirs_.push_back(tmp_dir);
-                      }
-                  } else {
-                      // late speculative copy – discard its output
-                      fs::remove_all(tmp_dir);
-                  }
-              }
-              if (!tasks[tidx].done.exchange(true)) --remaining;
-          }
+  // resumed job: tasks the journal shows as finished (and whose outputs were checked) are not run again
+  int n_recovered = 0;
+  for (int tidx=0; tidx<n_tasks; ++tidx) {
+    if (phase==Phase::MAP) {
+      auto it = done_.maps.find(tidx);
+      if (it == done_.maps.end()) continue;
+      accept_map(tidx, it->second.dir, it->second.worker, it->second.partition_bytes);
+    } else if (phase==Phase::REDUCE) {
+      if (!done_.reducers.count(tidx)) continue;
+    } else {
+      continue;
+    }
+    tasks[tidx].done = true;
+    --remaining;
+    ++n_recovered;
+  }
+  if (n_recovered > 0)
+    std::cout << "[MASTER] " << n_recovered << "/" << n_tasks << " task(s) already done (resumed job or earlier round)" << std::endl;
+
+  // starts the next task (or else a pre-merge job) on a free slot; false if there was nothing to run
+  auto launch = [&](int widx, int slot){
+    WorkerInfo &w = workers_[widx];
+    auto call = std::make_unique<TaskCall>();
+    call->widx = widx;
+    call->slot = slot;
+    call->ctx = std::make_shared<grpc::ClientContext>();
+    bool speculative = false;
+    const int tidx = take_task(widx, speculative);
+    if (tidx < 0) {
+      if (premerge_jobs.empty()) return false;   // only stale entries were left
+      call->kind = TaskCall::Kind::PREMERGE;
+      call->job = std::move(premerge_jobs.front()); premerge_jobs.pop_front();
+      call->attempt.id = next_attempt_id_++;
+      call->ctx->set_deadline(std::chrono::system_clock::now() + task_deadline_(task_input_bytes_(Phase::REDUCE, call->job.reducer_id)));
+      premerging[{widx,slot}] = call->ctx;
+      doPremergeTask(call->job, w, *call, cq);
+    } else {
+      w.state = WorkerState::BUSY;
+      call->attempt.tidx = tidx;
+      call->attempt.id = next_attempt_id_++;
+      call->attempt.start = std::chrono::steady_clock::now();
+      call->attempt.ctx = call->ctx;
+      call->attempt.speculative = speculative;
+      call->ctx->set_deadline(std::chrono::system_clock::now() + task_deadline_(task_input_bytes_(phase, tidx)));
+      running[{widx,slot}] = call->attempt;
+      if (speculative) ++spec_stats_.launched;
+      if (phase==Phase::MAP)         doMapTask(tasks[tidx].id, file_shards_[tidx], w, *call, cq);
+      else if (phase==Phase::REDUCE) doReduceTask(tasks[tidx].id, w, *call, cq);
+      else                           doSplitMergeTask(w, *call, cq);
+    }
+    ++w.busy_slots;
+    slot_busy[widx][slot] = true;
+    TaskCall *tag = call.get();
+    calls.emplace(tag, std::move(call));
+    return true;
+  };
+
+  // hands free slots out round-robin by slot index, so the first tasks spread over the workers
+  auto dispatch = [&]{
+    for (int s=0; s<max_slots; ++s) {
+      for (size_t i=0; i<workers_.size(); ++i) {
+        if (pending.empty() && spec_pending.empty() && premerge_jobs.empty()) return;
+        if (workers_[i].state==WorkerState::DEAD || s>=workers_[i].n_slots || slot_busy[i][s]) continue;
+        if (can_take((int)i)) launch((int)i, s);
       }
-      cv.notify_all();
     }
   };
 
-  std::vector<std::thread> threads;
-  for(size_t i=0;i<workers_.size();++i) if(workers_[i].state!=WorkerState::DEAD)
-    threads.emplace_back(worker_fn, (int)i);
-
-
-  // monitor for heartbeat
-  std::thread heartbeat([&]{
-        using namespace std::chrono_literals;
-        while (remaining>0) {
-            std::this_thread::sleep_for(1500ms);
-            for (size_t i=0;i<workers_.size();++i) {
-                auto &w = workers_[i];
-                if (w.state==WorkerState::DEAD) continue;
-                if (!w.channel->WaitForConnected(
-                        std::chrono::system_clock::now()+500ms)) {
-                    std::lock_guard lk(m);
-                    if (w.state==WorkerState::BUSY && running.count((int)i)) {
-                        int tidx = running[(int)i];
-                        pending.push_back(tidx);                 // requeue in‑flight task
-                        running.erase((int)i);
-                    }
-                    w.state = WorkerState::DEAD;
-                    cv.notify_all();
-                }
+  // hands the job's inputs back to the partition if it fails
+  auto premerge_done = [&](TaskCall &call){
+    WorkerInfo &w = workers_[call.widx];
+    const bool ok = call_succeeded_(call, "pre-merge", " (reducer " + std::to_string(call.job.reducer_id) + ")");
+    {
+        std::lock_guard pl(progress_mu_);
+        progress_.erase(call.attempt.id);
+    }
+    premerging.erase({call.widx,call.slot});
+    ShuffleState &sh = shuffle_[call.job.reducer_id];
+    sh.merging = false;
+    std::unordered_set<std::string> lost;
+    for (const auto &input : call.response.lost_inputs()) lost.insert(input.dir());
+    if (ok) {
+        sh.merged_dirs.push_back({call.out_dir, mr_spec_.worker_ipaddr_ports[call.widx]});
+    } else if (lost.empty() && call.status.error_code() != grpc::StatusCode::DEADLINE_EXCEEDED) {
+        w.state = WorkerState::DEAD;
+    } else if (!lost.empty()) {
+        drop_map_outputs_("", lost);                  // the worker is fine, some of its inputs are gone
+    }
+    if (!ok) {
+        for (const auto &out : call.job.input_dirs)
+            if (!lost.count(out.dir)) sh.unmerged_dirs.push_back(out);
+    }
+    if (w.state != WorkerState::DEAD)
+        w.state = w.busy_slots > 0 ? WorkerState::BUSY : WorkerState::IDLE;
+    queue_premerge(call.job.reducer_id);
+  };
+
+  auto task_done = [&](TaskCall &call){
+    const int widx = call.widx;
+    WorkerInfo &w = workers_[widx];
+    const Attempt &attempt = call.attempt;
+    const int tidx = attempt.tidx;
+    bool ok;
+    if (phase==Phase::MAP)         ok = call_succeeded_(call, "map", " (mapper " + std::to_string(tasks[tidx].id) + ")");
+    else if (phase==Phase::REDUCE) ok = call_succeeded_(call, "reduce", " (reducer " + std::to_string(tasks[tidx].id) + ")");
+    else                           ok = call_succeeded_(call, "split merge", "");
+
+    uint64_t attempt_bytes = 0;
+    {
+        std::lock_guard pl(progress_mu_);
+        auto it = progress_.find(attempt.id);
+        if (it != progress_.end()) attempt_bytes = it->second.bytes_total;
+        progress_.erase(attempt.id);
+    }
+    const int64_t attempt_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - attempt.start).count();
+    bool was_running = running.erase({widx,call.slot}) > 0; // false if the liveness check already requeued it
+    if (cancelled.erase(attempt.id) && !ok) {
+        // lost to another copy and stopped by the cancel; the worker removed its partial output itself
+        spec_stats_.wasted_ms += attempt_ms;
+        if (w.state != WorkerState::DEAD)
+            w.state = w.busy_slots > 0 ? WorkerState::BUSY : WorkerState::IDLE;
+        return;
+    }
+    if (!ok && call.response.lost_inputs_size() > 0) {
+        // the reducer is fine, map outputs it was given are gone: they run again, then so does this task
+        std::unordered_set<std::string> lost;
+        for (const auto &input : call.response.lost_inputs()) lost.insert(input.dir());
+        drop_map_outputs_("", lost);
+        shuffle_lost_ = true;
+        if (w.state != WorkerState::DEAD)
+            w.state = w.busy_slots > 0 ? WorkerState::BUSY : WorkerState::IDLE;
+        return;
+    }
+    if (!ok) {
+        // a deadline only says this attempt was slow or hung; the heartbeats decide whether the worker is
+        // alive. Any other failure marks it dead for the rest of the phase
+        if (call.status.error_code() == grpc::StatusCode::DEADLINE_EXCEEDED) {
+            if (w.state != WorkerState::DEAD)
+                w.state = w.busy_slots > 0 ? WorkerState::BUSY : WorkerState::IDLE;
+        } else {
+            w.state = WorkerState::DEAD;
+        }
+        // requeue unless another copy of the task is still running
+        if (was_running && !tasks[tidx].done.load() && attempts_of(tidx) == 0) enqueue(tidx);
+        return;
+    }
+    if (w.state != WorkerState::DEAD)
+        w.state = w.busy_slots > 0 ? WorkerState::BUSY : WorkerState::IDLE;
+    if (phase!=Phase::MAP) {
+        if (tasks[tidx].done.load()) {
+            discard_attempt_files_(call.response.output_files());  // another copy was committed first
+        } else if (bool partial = false; !commit_reduce_(call.response.output_files(), attempt.id, partial)) {
+            // a split merge run again would add the split keys a second time to the homes it did replace
+            if (phase==Phase::SPLIT_MERGE && partial) { split_homes_lost_ = true; return; }
+            if (was_running && attempts_of(tidx) == 0) enqueue(tidx);
+            return;
+        }
+    }
+    if (attempt_bytes > 0) {
+        worker_tput[widx].first  += attempt_bytes;
+        worker_tput[widx].second += std::max<int64_t>(attempt_ms, 1);
+        slow_node_stale = true;
+    }
+    if (phase==Phase::MAP) {
+        if (!tasks[tidx].accepted) {
+            const std::vector<uint64_t> part_bytes(call.response.partition_bytes().begin(), call.response.partition_bytes().end());
+            accept_map(tidx, call.out_dir, mr_spec_.worker_ipaddr_ports[widx], part_bytes);
+            std::string bytes;
+            for (size_t r=0; r<part_bytes.size(); ++r) bytes += (r ? "," : "") + std::to_string(part_bytes[r]);
+            record_("map " + std::to_string(tidx) + " " + mr_spec_.worker_ipaddr_ports[widx] + " " + call.out_dir + " " + bytes);
+            done_.maps[tidx] = {mr_spec_.worker_ipaddr_ports[widx], call.out_dir, part_bytes};
+        } else {
+            // late speculative copy – its output is dropped, without waiting for the worker
+            auto cleanup = std::make_unique<TaskCall>();
+            cleanup->widx = widx;
+            doCleanup(call.out_dir, w, *cleanup, cq);
+            TaskCall *tag = cleanup.get();
+            calls.emplace(tag, std::move(cleanup));
+        }
+    }
+    if (!tasks[tidx].done.exchange(true)) {
+        --remaining;
+        if (phase==Phase::REDUCE) {
+            record_("reduce " + std::to_string(tasks[tidx].id));
+            done_.reducers.insert(tasks[tidx].id);
+        }
+        if (attempt.speculative) {
+            ++spec_stats_.wins;
+            std::cout << "[MASTER]  – backup won (task=" << tidx << ", attempt=" << attempt.id << ")\n";
+        }
+        // the other copies have lost: cancel their RPCs so their workers stop and free the slots
+        for (const auto& [slot,a] : running) {
+            if (a.tidx != tidx || !cancelled.insert(a.id).second) continue;
+            std::cout << "[MASTER]  – cancelling losing attempt " << a.id << " (task=" << tidx << ")\n";
+            a.ctx->TryCancel();
+        }
+    } else {
+        spec_stats_.wasted_ms += attempt_ms;
+    }
+  };
+
+  auto on_done = [&](TaskCall *tag){
+    auto it = calls.find(tag);
+    if (it == calls.end()) return;
+    std::unique_ptr<TaskCall> call = std::move(it->second);
+    calls.erase(it);
+    if (call->kind == TaskCall::Kind::CLEANUP) {
+      call_succeeded_(*call, "cleanup", "");
+      return;
+    }
+    --workers_[call->widx].busy_slots;
+    slot_busy[call->widx][call->slot] = false;
+    if (call->kind == TaskCall::Kind::PREMERGE) premerge_done(*call);
+    else                                        task_done(*call);
+  };
+
+  // failure detection: a worker whose heartbeat stream has been silent for HEARTBEAT_TIMEOUT is dead
+  auto check_liveness = [&]{
+    const int64_t now = now_ms_();
+    for (size_t i=0;i<workers_.size();++i) {
+        auto &w = workers_[i];
+        if (w.state==WorkerState::DEAD) continue;
+        if (now - monitors_[i]->last_seen_ms.load() <= HEARTBEAT_TIMEOUT.count()) continue;
+        std::cout << "[MASTER] no heartbeat from worker " << mr_spec_.worker_ipaddr_ports[i]
+                  << " for " << (now - monitors_[i]->last_seen_ms.load()) << "ms, marking dead" << std::endl;
+        std::vector<int> lost;
+        for (auto it = running.begin(); it != running.end();) {
+            if (it->first.first == (int)i) {
+                lost.push_back(it->second.tidx);
+                it->second.ctx->TryCancel();          // its reply then arrives as a cancelled call
+                it = running.erase(it);
+            } else {
+                ++it;
             }
         }
-    });
-
-  // monitor for stragglers
-  std::thread spec([&]{
-    while(remaining>0){ 
-      std::this_thread::sleep_for(std::chrono::milliseconds(500));
-      std::lock_guard<std::mutex> lk(m);
-      if(running.empty()) continue;
+        for (auto &[slot,ctx] : premerging)
+            if (slot.first == (int)i) ctx->TryCancel();
+        for (int tidx : lost)                         // requeue in‑flight tasks with no surviving copy
+            if (!tasks[tidx].done.load() && attempts_of(tidx) == 0) enqueue(tidx);
+        w.state = WorkerState::DEAD;
+        // its finished maps went with it; the split merge reads only the shared output dir
+        if (phase != Phase::SPLIT_MERGE) drop_map_outputs_(mr_spec_.worker_ipaddr_ports[i], {});
+    }
+  };
+
+  // reducers need map outputs that are gone, or the split merge's home partitions must be reduced again:
+  // nothing new starts, the phase ends once the running ones return
+  auto stalled = [&]{ return (phase==Phase::REDUCE && shuffle_lost_) || (phase==Phase::SPLIT_MERGE && split_homes_lost_); };
+
+  // LATE-style straggler handling, driven by the progress reported in heartbeats:
+  // each attempt older than SPEC_MIN_AGE gets a rate (progress score / elapsed) and an estimated
+  // time left ((1 - score) / rate). Attempts slower than the SLOW_TASK_PERCENTILE of running rates
+  // are backed up longest-time-left first, at most spec_cap backups at once and one per task
+  auto speculate = [&]{
+      if(running.empty() || phase==Phase::SPLIT_MERGE) return;  // one task, with no other rates to compare it to
       auto now=std::chrono::steady_clock::now();
-      auto min_rt=std::chrono::milliseconds::max();
-      for(auto [widx,tidx]:running){
-        auto dur=std::chrono::duration_cast<std::chrono::milliseconds>(now-tasks[tidx].start);
-        if(dur<min_rt) min_rt=dur;
-      }
-      
-      auto scaled = std::chrono::milliseconds(static_cast<long long>(min_rt.count() * 2.5));
-      auto threshold = std::max(BASE_SPEC_MS, scaled);
-      for(auto [widx,tidx]:running){
-        auto dur=std::chrono::duration_cast<std::chrono::milliseconds>(now-tasks[tidx].start);
-        if (dur > threshold && !tasks[tidx].done.load()) {
-          if (std::find(pending.begin(), pending.end(), tidx) == pending.end()) {
-            std::cout << "[MASTER]  – speculative re-exec (task="
-                      << tidx << ", dur=" << dur.count() << "ms)\n";
-            pending.push_back(tidx);
-          }
+
+      struct Estimate { int tidx; double score, rate, time_left_s; };
+      std::vector<Estimate> estimates;
+      std::vector<double> rates;
+      std::unordered_map<int,int> copies; // running attempts per task
+      {
+        std::lock_guard pl(progress_mu_);
+        for(const auto& [slot,a]:running){
+          copies[a.tidx]++;
+          auto age=now-a.start;
+          if (age < SPEC_MIN_AGE) continue;
+          double score=0.0;
+          auto it = progress_.find(a.id);
+          if (it != progress_.end() && it->second.bytes_total > 0)
+            score = std::min(1.0, double(it->second.bytes_done) / double(it->second.bytes_total));
+          double rate = score / std::chrono::duration<double>(age).count();
+          double left = rate > 0 ? (1.0 - score) / rate : std::numeric_limits<double>::infinity();
+          rates.push_back(rate);
+          estimates.push_back({a.tidx, score, rate, left});
         }
       }
-      cv.notify_all();
+      if (estimates.empty()) return;
+      const double slow_rate = percentile_(rates, SLOW_TASK_PERCENTILE);
+
+      std::sort(estimates.begin(), estimates.end(),
+                [](const Estimate& a, const Estimate& b){ return a.time_left_s > b.time_left_s; });
+      int budget = spec_cap - backups_in_flight();
+      for(const auto& e:estimates){
+        if (budget <= 0) break;
+        if (tasks[e.tidx].done.load() || copies[e.tidx] > 1 || e.rate > slow_rate) continue;
+        if (std::find(spec_pending.begin(), spec_pending.end(), e.tidx) != spec_pending.end() ||
+            queued[e.tidx]) continue;
+        std::cout << "[MASTER]  – speculative re-exec (task=" << e.tidx << ", progress=" << e.score
+                  << ", rate=" << e.rate << "/s, est. left=" << e.time_left_s << "s)\n";
+        spec_pending.push_back(e.tidx);
+        --budget;
+      }
+  };
+
+  // event loop: runs until every task is done and the losing copies and pre-merge jobs still
+  // in flight at the barrier have returned
+  auto next_liveness = std::chrono::steady_clock::now() + HEARTBEAT_INTERVAL;
+  auto next_spec     = std::chrono::steady_clock::now() + SPEC_INTERVAL;
+  dispatch();
+  while ((remaining>0 && !stalled()) || !calls.empty()) {
+    void *tag; bool ok;
+    // timed, since a task's locality wait can expire and heartbeats can go silent without any reply arriving
+    if (cq.AsyncNext(&tag, &ok, std::chrono::system_clock::now() + EVENT_LOOP_TICK) == grpc::CompletionQueue::GOT_EVENT)
+      on_done(static_cast<TaskCall*>(tag));
+
+    const auto now = std::chrono::steady_clock::now();
+    if (now >= next_liveness) { check_liveness(); next_liveness = now + HEARTBEAT_INTERVAL; }
+    if (remaining == 0 || stalled()) continue;
+    if (now >= next_spec) { speculate(); next_spec = now + SPEC_INTERVAL; }
+    dispatch();
+    if (calls.empty() && std::none_of(workers_.begin(), workers_.end(),
+                                      [](const WorkerInfo &w){ return w.state != WorkerState::DEAD; })) {
+      std::cerr << "[MASTER] no live worker left, " << remaining << " task(s) unfinished" << std::endl;
+      phase_ok = false;
+      break;
+    }
+  }
+  cq.Shutdown();
+  { void *tag; bool ok; while (cq.Next(&tag, &ok)) {} }
+  if (remaining > 0 && stalled()) {
+    if (phase==Phase::REDUCE)
+      std::cout << "[MASTER] " << remaining << " reducer(s) wait for lost map outputs to be rebuilt" << std::endl;
+    phase_ok = false;
+  }
+
+  // jobs still queued at the barrier are dropped; the reducers read their inputs directly
+  for (auto &job : premerge_jobs) {
+    ShuffleState &sh = shuffle_[job.reducer_id];
+    sh.unmerged_dirs.insert(sh.unmerged_dirs.end(), job.input_dirs.begin(), job.input_dirs.end());
+    sh.merging = false;
+  }
+  locality_stats_.local  += locality.local;
+  locality_stats_.remote += locality.remote;
+  std::cout << "[MASTER] locality: " << locality.local << " local, " << locality.remote << " remote launch(es)" << std::endl;
+  if (phase==Phase::MAP) {
+    size_t merged=0, unmerged=0;
+    for (const auto &sh : shuffle_) { merged += sh.merged_dirs.size(); unmerged += sh.unmerged_dirs.size(); }
+    std::cout << "[MASTER] shuffle: " << merged << " pre-merged run(s), " << unmerged
+              << " map output(s) left for the reducers" << std::endl;
+  }
+  {
+      std::lock_guard pl(progress_mu_);
+      progress_.clear();  // late heartbeats may have re-added finished attempts
+  }
+  std::cout << "[MASTER] " << phase_name << " phase took " << std::chrono::duration_cast<std::chrono::milliseconds>(
+                   std::chrono::steady_clock::now() - phase_start).count() << " ms" << std::endl;
+
+  return phase_ok;
+}
+
+inline void Master::drop_map_outputs_(const std::string &worker, const std::unordered_set<std::string> &dirs) {
+  auto is_lost = [&](const std::string &dir, const std::string &on){
+    return dirs.empty() ? on == worker : dirs.count(dir) > 0;
+  };
+  bool lost = false;
+  for (auto it = done_.maps.begin(); it != done_.maps.end();) {
+    if (!is_lost(it->second.dir, it->second.worker)) { ++it; continue; }
+    std::cout << "[MASTER] map output of mapper " << it->first << " on " << it->second.worker << " is lost" << std::endl;
+    it = done_.maps.erase(it);
+    lost = true;
+  }
+  // also pre-merged runs, whose maps may live elsewhere but which the reducers were told to read
+  for (const auto &sh : shuffle_)
+    for (const auto *outputs : {&sh.merged_dirs, &sh.unmerged_dirs})
+      for (const auto &out : *outputs) lost = lost || is_lost(out.dir, out.worker);
+  if (lost) shuffle_lost_ = true;
+}
+
+inline int64_t Master::now_ms_() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* p-th percentile (0..1) by nearest rank; 0 for an empty sample */
+inline double Master::percentile_(std::vector<double> v, double p) {
+  if (v.empty()) return 0.0;
+  size_t k = static_cast<size_t>(p * (v.size() - 1));
+  std::nth_element(v.begin(), v.begin() + k, v.end());
+  return v[k];
+}
+
+/* Per task, the live workers holding the most of its data:
+	MAP    - bytes of the shard's pieces in files the worker reported as local
+	REDUCE - map output / pre-merged dirs of the partition on the worker's disk
+	Empty if no worker holds any of it */
+inline std::vector<std::vector<int>> Master::preferred_workers_(Phase phase, int n_tasks) const {
+  std::vector<std::vector<int>> preferred(n_tasks);
+  for (int t = 0; t < n_tasks; ++t) {
+    std::vector<uint64_t> held(workers_.size(), 0);
+    for (size_t i = 0; i < workers_.size(); ++i) {
+      if (workers_[i].state == WorkerState::DEAD) continue;
+      if (phase == Phase::MAP) {
+        for (const auto &piece : file_shards_[t].pieces)
+          if (workers_[i].local_inputs.count(piece.filepath)) held[i] += piece.end_offset - piece.start_offset;
+      } else if (phase == Phase::REDUCE) {
+        for (const auto *outputs : {&shuffle_[t].merged_dirs, &shuffle_[t].unmerged_dirs})
+          for (const auto &out : *outputs)
+            if (out.worker == mr_spec_.worker_ipaddr_ports[i]) held[i]++;
+      }
+    }
+    const uint64_t best = held.empty() ? 0 : *std::max_element(held.begin(), held.end());
+    if (best == 0) continue;
+    for (size_t i = 0; i < workers_.size(); ++i)
+      if (held[i] == best) preferred[t].push_back((int)i);
+  }
+  return preferred;
+}
+
+/* Bytes an attempt of the task reads: the shard for a map, the partition's map output for a reduce
+	or pre-merge, all split-key partials (bounded by all map output) for the split merge */
+inline uint64_t Master::task_input_bytes_(Phase phase, int tidx) const {
+  uint64_t bytes = 0;
+  if (phase == Phase::MAP) {
+    for (const auto &piece : file_shards_[tidx].pieces) bytes += piece.end_offset - piece.start_offset;
+  } else if (phase == Phase::REDUCE) {
+    if (tidx < (int)partition_bytes_.size()) bytes = partition_bytes_[tidx];
+  } else {
+    for (uint64_t b : partition_bytes_) bytes += b;
+  }
+  return bytes;
+}
+
+/* Deadline of one attempt: a fixed allowance plus its input at TASK_DEADLINE_MIN_RATE. Generous on
+	purpose, stragglers are handled by speculation; this only frees the slot of a hung worker */
+inline std::chrono::milliseconds Master::task_deadline_(uint64_t input_bytes) const {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(TASK_DEADLINE_BASE) +
+         std::chrono::milliseconds(input_bytes * 1000 / TASK_DEADLINE_MIN_RATE);
+}
+
+inline void Master::print_job_stats_() const {
+  const int launches = locality_stats_.local + locality_stats_.remote;
+  if (launches == 0)
+    std::cout << "[MASTER] locality: n/a, no task's data was local to any worker" << std::endl;
+  else
+    std::cout << "[MASTER] locality: " << locality_stats_.local << "/" << launches << " task launch(es) local ("
+              << 100.0 * locality_stats_.local / launches << "% hit rate)" << std::endl;
+  int64_t created = 0, reused = 0;
+  for (const auto &mon : monitors_) { created += mon->objects_created.load(); reused += mon->objects_reused.load(); }
+  std::cout << "[MASTER] task pools: " << created << " mapper/reducer object(s) built, " << reused
+            << " lease(s) reused a pooled one (as of the last heartbeats)" << std::endl;
+  std::cout << "[MASTER] speculative execution: " << spec_stats_.launched << " backup(s) launched, "
+            << spec_stats_.wins << " won, " << spec_stats_.wasted_ms << "ms of redundant work" << std::endl;
+}
+
+inline void Master::start_heartbeats_() {
+  const int64_t now = now_ms_();
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    auto mon = std::make_unique<HeartbeatMonitor>();
+    mon->widx = (int)i;
+    for (int op = 0; op < 5; ++op) mon->tags[op] = {mon.get(), static_cast<HeartbeatMonitor::Op>(op)};
+    mon->last_seen_ms = now;  // grace period for the first heartbeat
+    monitors_.push_back(std::move(mon));
+  }
+  heartbeat_cq_ = std::make_unique<grpc::CompletionQueue>();
+  heartbeat_thread_ = std::thread(&Master::heartbeat_loop_, this);
+}
+
+inline void Master::stop_heartbeats_() {
+  stopping_ = true;
+  for (auto &mon : monitors_) {
+    std::lock_guard lk(mon->ctx_mu);
+    if (mon->ctx) mon->ctx->TryCancel();
+  }
+  if (heartbeat_thread_.joinable()) heartbeat_thread_.join();
+}
+
+/* Opens a heartbeat stream to the monitor's worker; false once the master is stopping */
+inline bool Master::connect_heartbeat_(HeartbeatMonitor &mon) {
+  std::lock_guard lk(mon.ctx_mu);
+  if (stopping_) return false;
+  mon.ctx = std::make_unique<grpc::ClientContext>();
+  mon.stream = workers_[mon.widx].stub->PrepareAsyncheartbeat(mon.ctx.get(), heartbeat_cq_.get());
+  mon.open = true;
+  mon.stream->StartCall(&mon.tags[static_cast<int>(HeartbeatMonitor::Op::START)]);
+  return true;
+}
+
+/* One step of a stream: START -> WRITE (the interval) -> WRITES_DONE -> READ ... READ, and FINISH
+	once any step fails. Every read records what the worker reports */
+inline void Master::on_heartbeat_event_(HeartbeatMonitor::Tag &tag, bool ok) {
+  using Op = HeartbeatMonitor::Op;
+  HeartbeatMonitor &mon = *tag.mon;
+  auto tag_of = [&](Op op){ return &mon.tags[static_cast<int>(op)]; };
+
+  if (tag.op == Op::FINISH) {
+    std::lock_guard lk(mon.ctx_mu);
+    mon.stream.reset();
+    mon.ctx.reset();
+    mon.open = false;
+    // stream dropped: back off briefly, the run_phase liveness check decides whether the worker is dead
+    mon.reconnect_at = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+    return;
+  }
+  if (!ok) {
+    mon.stream->Finish(&mon.status, tag_of(Op::FINISH));
+    return;
+  }
+
+  switch (tag.op) {
+    case Op::START:
+      mon.request.set_interval_ms(static_cast<int32_t>(HEARTBEAT_INTERVAL.count()));
+      mon.stream->Write(mon.request, tag_of(Op::WRITE));
+      break;
+    case Op::WRITE:
+      mon.stream->WritesDone(tag_of(Op::WRITES_DONE));
+      break;
+    case Op::READ: {
+      mon.last_seen_ms = now_ms_();
+      mon.rss_bytes = mon.hb.rss_bytes();
+      mon.objects_created = mon.hb.task_objects_created();
+      mon.objects_reused = mon.hb.task_objects_reused();
+
+      auto now = std::chrono::steady_clock::now();
+      std::lock_guard pl(progress_mu_);
+      for (const auto &t : mon.hb.tasks()) {
+        auto &p = progress_[t.attempt_id()];
+        if (static_cast<uint64_t>(t.bytes_done()) != p.bytes_done || p.updated.time_since_epoch().count() == 0)
+          p.updated = now;
+        p.bytes_done  = static_cast<uint64_t>(t.bytes_done());
+        p.bytes_total = static_cast<uint64_t>(t.bytes_total());
+        p.records     = static_cast<uint64_t>(t.records_emitted());
+      }
     }
-  });
+      [[fallthrough]];
+    case Op::WRITES_DONE:
+      mon.stream->Read(&mon.hb, tag_of(Op::READ));
+      break;
+    default:
+      break;
+  }
+}
 
-  for(auto &t:threads) t.join(); 
-  heartbeat.join();
-  spec.join();
+/* Drives the heartbeat streams of all workers from one completion queue, reconnecting dropped ones */
+inline void Master::heartbeat_loop_() {
+  for (auto &mon : monitors_) connect_heartbeat_(*mon);
+
+  auto next_scan = std::chrono::steady_clock::now();
+  while (true) {
+    void *tag; bool ok;
+    if (heartbeat_cq_->AsyncNext(&tag, &ok, std::chrono::system_clock::now() + EVENT_LOOP_TICK) ==
+        grpc::CompletionQueue::GOT_EVENT)
+      on_heartbeat_event_(*static_cast<HeartbeatMonitor::Tag*>(tag), ok);
+
+    const auto now = std::chrono::steady_clock::now();
+    if (now < next_scan) continue;
+    next_scan = now + EVENT_LOOP_TICK;
+    bool any_open = false;
+    for (auto &mon : monitors_) {
+      if (!mon->open && now >= mon->reconnect_at) connect_heartbeat_(*mon);
+      any_open = any_open || mon->open;
+    }
+    if (stopping_ && !any_open) break;
+  }
+  heartbeat_cq_->Shutdown();
+  void *tag; bool ok;
+  while (heartbeat_cq_->Next(&tag, &ok)) {}
+}
 
+/* Everything the journal's records depend on: a journal written for other inputs or settings is not resumed */
+inline std::string Master::plan_fingerprint_() const {
+  std::ostringstream plan;
+  plan << mr_spec_.user_id << '|' << mr_spec_.output_dir << '|' << mr_spec_.n_output_files << '|'
+       << mr_spec_.intermediate_format << '|' << mr_spec_.intermediate_compression << '|' << mr_spec_.output_compression << '|'
+       << mr_spec_.partitioner << '|' << mr_spec_.hot_key_split << '|' << mr_spec_.reduce_mode;
+  for (const auto &shard : file_shards_) {
+    plan << '#';
+    for (const auto &piece : shard.pieces) plan << piece.filepath << ':' << piece.start_offset << '-' << piece.end_offset << ';';
+  }
 
-  return phase_ok.load();
+  // FNV-1a 64
+  uint64_t h = 14695981039346656037ull;
+  for (unsigned char c : plan.str()) { h ^= c; h *= 1099511628211ull; }
+  std::ostringstream hex;
+  hex << std::hex << h;
+  return hex.str();
+}
+
+inline void Master::open_journal_() {
+  const fs::path root = fs::path(INTERMEDIATE_ROOT_DIR) / mr_spec_.user_id;
+  const std::string path = (root / "journal.log").string();
+  std::error_code ec;
+  fs::create_directories(root, ec);
+
+  JobJournal::State state;
+  if (JobJournal::load(path, state)) {
+    if (state.plan == plan_fingerprint_() && state.has_partitioning) {
+      resumed_ = true;
+      done_ = std::move(state);
+      std::cout << "[MASTER] resume: journal " << path << " lists " << done_.maps.size() << " accepted map(s), "
+                << done_.reducers.size() << " finished reducer(s)" << std::endl;
+    } else {
+      std::cout << "[MASTER] journal " << path << " belongs to a different job plan, starting over" << std::endl;
+    }
+  }
+  if (!journal_.open(path, !resumed_))
+    std::cerr << "[MASTER] WARNING: no job journal, this job cannot be resumed" << std::endl;
+}
+
+/* Resumed job: reuses the journaled partitioning, so the recovered map outputs stay valid, and keeps
+	only the finished reducers whose outputs are still in place. False for a new job */
+inline bool Master::restore_from_journal_() {
+  if (!resumed_) return false;
+
+  partitioning_.Clear();
+  split_keys_.clear();
+  split_key_homes_.clear();
+  partitioning_.ParseFromString(done_.partitioning);
+  std::set<int> homes;
+  for (const auto &hk : partitioning_.hot_keys()) {
+    split_keys_.push_back(hk.key());
+    split_key_homes_.push_back(hk.partitions_size() > 0 ? hk.partitions(0) : 0);
+    homes.insert(split_key_homes_.back());
+  }
+  std::cout << "[MASTER] resume: partitioning restored, " << split_keys_.size() << " split key(s)" << std::endl;
+
+  const std::string ext = mr_spec_.output_compression == "lz4" ? ".txt.lz4" : ".txt";
+  for (auto it = done_.reducers.begin(); it != done_.reducers.end();) {
+    const fs::path dir(mr_spec_.output_dir);
+    std::error_code ec;
+    bool intact = fs::is_regular_file(dir / ("output_" + std::to_string(*it) + ext), ec);
+    // a split merge that was being committed may have replaced some home partitions and not others
+    if (!split_keys_.empty() && !done_.split_done) {
+      intact = intact && fs::is_regular_file(dir / split_run_name(*it), ec) &&
+               !(done_.split_started && homes.count(*it));
+    }
+    if (intact) { ++it; continue; }
+    std::cout << "[MASTER] resume: output of reducer " << *it << " is not usable, it runs again" << std::endl;
+    it = done_.reducers.erase(it);
+  }
+  return true;
+}
+
+inline void Master::record_(const std::string &record) {
+  if (journal_.is_open() && !journal_.append(record))
+    std::cerr << "[MASTER] WARNING: failed to journal '" << record << "'" << std::endl;
 }
 
 inline std::string Master::gen_random_id_() const {
@@ -344,9 +1497,23 @@ inline std::string Master::gen_random_id_() const {
   return id;
 }
 
+inline masterworker::CompressionType Master::compression_type_(const std::string &name) {
+  return name == "lz4" ? masterworker::COMPRESSION_LZ4 : masterworker::COMPRESSION_NONE;
+}
+
+inline masterworker::ReduceMode Master::reduce_mode_() const {
+  return mr_spec_.reduce_mode == "hash" ? masterworker::REDUCE_HASH : masterworker::REDUCE_SORTED;
+}
+
 inline void Master::cleanup_output_dir_() {
   fs::path outdir(mr_spec_.output_dir);
   std::error_code ec;
+  if (resumed_) {
+    // finished reducers' outputs are kept; the others are replaced when they run again
+    fs::create_directories(outdir, ec);
+    sweep_attempt_files_();
+    return;
+  }
   if (!fs::exists(outdir, ec)) {
     fs::create_directories(outdir, ec);
     if (ec) std::cerr << "[MASTER] Warning: failed to create output_dir '" << outdir
@@ -363,11 +1530,91 @@ inline void Master::cleanup_output_dir_() {
   }
 }
 
+inline bool Master::commit_reduce_(const std::string &attempt_files, int64_t attempt_id, bool &partial) {
+  const std::string suffix = "." + std::to_string(attempt_id) + ".tmp";
+  std::vector<std::string> files;
+  std::stringstream list(attempt_files);
+  std::string file;
+  while (std::getline(list, file, ',')) files.push_back(file);
+
+  partial = false;
+  std::error_code ec;
+  // every file is checked before the first rename, so a bad report leaves the committed outputs untouched
+  for (const auto &f : files) {
+    if (f.size() <= suffix.size() || f.compare(f.size() - suffix.size(), suffix.size(), suffix) != 0) {
+      std::cerr << "[MASTER] attempt " << attempt_id << " reported unexpected output '" << f << "'" << std::endl;
+      discard_attempt_files_(attempt_files);
+      return false;
+    }
+    if (!fs::is_regular_file(f, ec)) {
+      std::cerr << "[MASTER] attempt " << attempt_id << " output '" << f << "' is missing" << std::endl;
+      discard_attempt_files_(attempt_files);
+      return false;
+    }
+  }
+  for (size_t i = 0; i < files.size(); ++i) {
+    // same directory, so the rename is atomic: readers see the old file or this attempt's, nothing in between
+    fs::rename(files[i], files[i].substr(0, files[i].size() - suffix.size()), ec);
+    if (ec) {
+      std::cerr << "[MASTER] failed to commit '" << files[i] << "': " << ec.message() << std::endl;
+      partial = i > 0;
+      for (size_t j = i; j < files.size(); ++j) fs::remove(files[j], ec);
+      return false;
+    }
+  }
+  return true;
+}
+
+inline void Master::discard_attempt_files_(const std::string &attempt_files) {
+  std::stringstream files(attempt_files);
+  std::string file;
+  std::error_code ec;
+  while (std::getline(files, file, ',')) fs::remove(file, ec);
+}
+
+inline void Master::remove_split_runs_() {
+  std::error_code ec;
+  for (auto &entry : fs::directory_iterator(mr_spec_.output_dir, ec))
+    if (is_split_run(entry.path().filename().string())) fs::remove(entry.path(), ec);
+}
+
+inline void Master::sweep_attempt_files_() {
+  std::error_code ec;
+  for (auto &entry : fs::directory_iterator(mr_spec_.output_dir, ec)) {
+    const std::string name = entry.path().filename().string();
+    if (name.size() > 4 && name.compare(name.size() - 4, 4, ".tmp") == 0) fs::remove(entry.path(), ec);
+  }
+}
+
+/* Removes each (worker, dir) target from the worker's local disk, all requests in flight at once */
+inline void Master::remove_intermediate_(const std::vector<std::pair<int, std::string>> &targets) {
+  grpc::CompletionQueue cq;
+  std::vector<std::unique_ptr<TaskCall>> calls;
+  for (const auto &[widx, dir] : targets) {
+    calls.push_back(std::make_unique<TaskCall>());
+    calls.back()->widx = widx;
+    doCleanup(dir, workers_[widx], *calls.back(), cq);
+  }
+
+  void *tag; bool ok;
+  for (size_t n = 0; n < calls.size() && cq.Next(&tag, &ok); ++n)
+    call_succeeded_(*static_cast<TaskCall*>(tag), "cleanup", "");
+  cq.Shutdown();
+  while (cq.Next(&tag, &ok)) {}
+}
+
 inline void Master::cleanup_intermediate_() {
   const fs::path root = fs::path(INTERMEDIATE_ROOT_DIR) / mr_spec_.user_id;
 
   std::cout << "[MASTER] Removing intermediate files under " << root.string() << std::endl;
 
+  // map outputs live on the workers' local disks; the local remove covers a shared filesystem
+  std::vector<std::pair<int, std::string>> targets;
+  for (size_t i = 0; i < workers_.size(); ++i) {
+    if (workers_[i].state != WorkerState::DEAD) targets.emplace_back((int)i, root.string());
+  }
+  remove_intermediate_(targets);
+
   std::error_code ec;
   fs::remove_all(root, ec);
   if (ec) {
@@ -394,7 +1641,21 @@ inline void Master::print_mr_spec_() const {
     }
     std::cout << "Output Directory: " << mr_spec_.output_dir << std::endl;
     std::cout << "Number of Output Files: " << mr_spec_.n_output_files << std::endl;
-    std::cout << "Map Kilobytes: " << mr_spec_.map_kilobytes << "\n" << std::endl;
+    if (mr_spec_.map_kilobytes_auto) {
+        std::cout << "Map Kilobytes: auto (" << mr_spec_.shard_waves_per_worker << " waves/worker, "
+                  << (mr_spec_.min_shard_kilobytes > 0 ? std::to_string(mr_spec_.min_shard_kilobytes) : std::string("floor"))
+                  << "-" << mr_spec_.max_shard_kilobytes << " KB)" << std::endl;
+    } else {
+        std::cout << "Map Kilobytes: " << mr_spec_.map_kilobytes << std::endl;
+    }
+    std::cout << "Intermediate Format: " << mr_spec_.intermediate_format << std::endl;
+    std::cout << "Map Buffer Kilobytes: " << mr_spec_.map_buffer_kilobytes << std::endl;
+    std::cout << "Partitioner: " << mr_spec_.partitioner << ", Hot Key Split: " << mr_spec_.hot_key_split << std::endl;
+    std::cout << "Compression: intermediate " << mr_spec_.intermediate_compression
+              << ", output " << mr_spec_.output_compression << std::endl;
+    std::cout << "Reduce Mode: " << mr_spec_.reduce_mode << " (hash table limit " << mr_spec_.hash_reduce_max_megabytes
+              << " MB)" << std::endl;
+    std::cout << "Slow Worker Probability: " << mr_spec_.slow_worker_probability << "\n" << std::endl;
 }
 
 inline void Master::print_file_shards_() const {
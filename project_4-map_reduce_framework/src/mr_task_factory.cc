@@ -15,6 +15,11 @@ void BaseMapper::emit(const std::string& key, const std::string& val) {
 	impl_->emit(key, val);	
 }
 
+void BaseMapper::map_view(std::string_view input_line) {
+	impl_->line_buffer.assign(input_line.data(), input_line.size());
+	map(impl_->line_buffer);
+}
+
 
 BaseReducer::BaseReducer() : impl_(new BaseReducerInternal) {}
 
@@ -25,6 +30,15 @@ void BaseReducer::emit(const std::string& key, const std::string& val) {
 }
 
 
+BaseCombiner::BaseCombiner() : impl_(new BaseCombinerInternal) {}
+
+BaseCombiner::~BaseCombiner() {}
+
+void BaseCombiner::emit(const std::string& key, const std::string& val) {
+	impl_->emit(key, val);	
+}
+
+
 namespace {
 
 	class TaskFactory
@@ -34,9 +48,11 @@ namespace {
 
 		  std::shared_ptr<BaseMapper> get_mapper(const std::string& user_id);
 		  std::shared_ptr<BaseReducer> get_reducer(const std::string& user_id);
+		  std::shared_ptr<BaseCombiner> get_combiner(const std::string& user_id);
 
 	 	  std::unordered_map<std::string, std::function<std::shared_ptr<BaseMapper>()> > mappers_;
 		  std::unordered_map<std::string, std::function<std::shared_ptr<BaseReducer>()> > reducers_;
+		  std::unordered_map<std::string, std::function<std::shared_ptr<BaseCombiner>()> > combiners_;
 
 		private:
 		  TaskFactory();
@@ -68,6 +84,14 @@ namespace {
 			return nullptr;
 		return itr->second();
 	}
+
+
+	std::shared_ptr<BaseCombiner> TaskFactory::get_combiner(const std::string& user_id) {
+		auto itr = combiners_.find(user_id);
+		if (itr == combiners_.end())
+			return nullptr;
+		return itr->second();
+	}
 }
 
 
@@ -81,6 +105,17 @@ bool register_tasks(
 		&& factory.reducers_.insert(std::make_pair(user_id, generate_reducer)).second;
 }
 
+bool register_tasks(
+	std::string user_id,  
+	std::function<std::shared_ptr<BaseMapper>() >& generate_mapper,
+	std::function<std::shared_ptr<BaseReducer>() >& generate_reducer,
+	std::function<std::shared_ptr<BaseCombiner>() >& generate_combiner
+	) {
+	TaskFactory& factory = TaskFactory::instance();
+	return register_tasks(user_id, generate_mapper, generate_reducer)
+		&& factory.combiners_.insert(std::make_pair(user_id, generate_combiner)).second;
+}
+
 std::shared_ptr<BaseMapper> get_mapper_from_task_factory(const std::string& user_id) {
 	return TaskFactory::instance().get_mapper(user_id);
 }
@@ -89,3 +124,8 @@ std::shared_ptr<BaseMapper> get_mapper_from_task_factory(const std::string& user
 std::shared_ptr<BaseReducer> get_reducer_from_task_factory(const std::string& user_id) {
 	return TaskFactory::instance().get_reducer(user_id);
 }
+
+
+std::shared_ptr<BaseCombiner> get_combiner_from_task_factory(const std::string& user_id) {
+	return TaskFactory::instance().get_combiner(user_id);
+}
@@ -3,9 +3,84 @@
 #include <string>
 #include <iostream>
 #include <map>
+#include <vector>
 #include <filesystem>
 #include <unordered_map>
 #include <fstream>
+#include <algorithm>
+#include <memory>
+#include <functional>
+#include <cstring>
+#include <cerrno>
+#include <string_view>
+
+#include <mr_task_factory.h>
+#include "intermediate_io.h"
+#include "partitioner.h"
+#include "output_writer.h"
+
+
+/* CS6210_TASK Implement this data structureas per your implementation.
+		You will need this when your worker runs the combiner inside a map task*/
+struct BaseCombinerInternal {
+
+		BaseCombinerInternal();
+
+		void emit(const std::string& key, const std::string& val);
+
+		/* Receives every pair combine() emits: the mapper's arena, or a merged run on disk */
+		using Sink = std::function<void(const std::string&, const std::string&)>;
+
+		void initialization(const Sink* sink);
+
+	private:
+		const Sink* sink_;
+};
+
+
+inline BaseCombinerInternal::BaseCombinerInternal() : sink_(nullptr) {}
+
+
+/* combined pairs go straight back to wherever the mapper is collecting them */
+inline void BaseCombinerInternal::emit(const std::string& key, const std::string& val) {
+	(*sink_)(key, val);
+}
+
+inline void BaseCombinerInternal::initialization(const Sink* sink) {
+	sink_ = sink;
+}
+
+
+/*-----------------------------------------------------------------------------------------------*/
+
+
+/* Bump arena holding the bytes a map task emits. Records refer to it by offset, so growing the backing
+	vector never invalidates them, and clear() frees every record at once while keeping the capacity */
+class EmitArena {
+
+	public:
+		/* Copies a then b back to back and returns the offset of a */
+		uint64_t append(std::string_view a, std::string_view b) {
+			const size_t offset = bytes_.size();
+			bytes_.resize(offset + a.size() + b.size());
+			if (!a.empty()) std::memcpy(bytes_.data() + offset, a.data(), a.size());
+			if (!b.empty()) std::memcpy(bytes_.data() + offset + a.size(), b.data(), b.size());
+			return offset;
+		}
+
+		std::string_view view(uint64_t offset, uint32_t len) const {
+			return std::string_view(bytes_.data() + offset, len);
+		}
+
+		size_t size() const { return bytes_.size(); }
+		size_t capacity() const { return bytes_.capacity(); }
+		void clear() { bytes_.clear(); }
+		void release() { std::vector<char>().swap(bytes_); }
+
+	private:
+		std::vector<char> bytes_;
+};
+
 
 
 /* CS6210_TASK Implement this data structureas per your implementation.
@@ -20,69 +95,318 @@ struct BaseMapperInternal {
 
 		/* NOW you can add below, data members and member functions as per the need of your implementation*/
 	
-		void initialization(const int mapper_id, const std::string& intermediate_file_dir, const int n_output);
+		void initialization(const int mapper_id, const std::string& intermediate_file_dir, const int n_output,
+				const IntermediateFormat format = IntermediateFormat::BINARY, const size_t buffer_bytes = 0,
+				const Compression compression = Compression::NONE);
+
+		void set_combiner(std::shared_ptr<BaseCombiner> combiner);
+		void set_partitioner(std::shared_ptr<Partitioner> partitioner);
+		/* false (reduce_mode=hash): runs are written in emit order unless a combiner needs the key groups */
+		void set_sort_runs(bool sort) { sort_runs_ = sort; }
+		/* Sampling mode: emitted keys are appended to sink and nothing is buffered or written */
+		void set_key_sink(std::vector<std::string>* sink) { key_sink_ = sink; }
 
 		int get_hashed_val(const std::string& key);
+		int get_partition(const std::string& key);
+
+		/* Writes the task's final intermediate files; false if any spill, merge or write failed (error()
+			says which). The files of a failed task are incomplete and must not be handed to reducers */
+		bool save_as_files();
+		const std::string& error() const { return error_; }
+
+		/* Back to the just-constructed state for the next task of a pooled mapper. The combiner stays
+			set, and the partition buffers and arena keep their capacity unless it grew past the caps below */
+		void reset();
 
-		void save_as_files();
+		size_t n_emitted() const { return n_emitted_; }
+
+		std::string line_buffer;  // reused by the default BaseMapper::map_view
 
 	private:
+		/* One emitted pair: key_len bytes of key followed by val_len bytes of value, at offset in arena_ */
+		struct Record {
+			uint64_t offset;
+			uint32_t key_len;
+			uint32_t val_len;
+		};
+		using Buffer = std::vector<Record>;
+
+		std::string_view key_of_(const Record& r) const { return arena_.view(r.offset, r.key_len); }
+		std::string_view val_of_(const Record& r) const { return arena_.view(r.offset + r.key_len, r.val_len); }
+		void append_(Buffer& buffer, std::string_view key, std::string_view val);
+
+		bool runs_sorted_() const { return sort_runs_ || combiner_ != nullptr; }
+		void sort_and_combine_(Buffer& buffer);
+		void combine_group_(const std::string& key, const std::vector<std::string>& values, const BaseCombinerInternal::Sink& sink);
+		bool write_run_(const std::string& path, IntermediateFormat format, const Buffer& buffer);
+		bool spill_();
+		bool merge_spills_(int reducer_id);
+		bool fail_(const std::string& what);
+
 		int mapper_id_;
 		int n_output_;
-		int buffered_words_count;
+		size_t buffered_bytes_;
+		size_t buffer_bytes_limit_;  // 0 = keep everything in memory until save_as_files
+		int n_spills_;
+		size_t n_emitted_;
     	std::string intermediate_file_dir_;
-		std::vector<std::vector<std::pair<std::string, std::string>>> reducerBuffers;
+		IntermediateFormat format_;
+		Compression compression_ = Compression::NONE;  // final runs and spills
+		bool sort_runs_ = true;
+		std::shared_ptr<BaseCombiner> combiner_;
+		std::shared_ptr<Partitioner> partitioner_;  // null = get_hashed_val
+		std::vector<std::string>* key_sink_;
+		EmitArena arena_;                            // bytes of every buffered record, dropped after each spill
+		std::vector<Buffer> reducerBuffers;
+		std::vector<std::vector<std::string>> spill_runs_;  // per reducer, sorted run files spilled so far
+		std::string error_;                          // first write failure; a spill from emit() has no one to tell
+
+		// one key group handed to the combiner; the strings are reused from group to group
+		std::string group_key_;
+		std::vector<std::string> group_values_;
+
+		static constexpr size_t MAX_RETAINED_BYTES = 4 << 20;         // per partition buffer kept across tasks
+		static constexpr size_t MAX_RETAINED_ARENA_BYTES = 64 << 20;  // arena kept across tasks
 };
 
 
 /* CS6210_TASK Implement this function */
 inline BaseMapperInternal::BaseMapperInternal() {
-	buffered_words_count = 0;
+	buffered_bytes_ = 0;
+	buffer_bytes_limit_ = 0;
+	n_spills_ = 0;
+	n_emitted_ = 0;
+	key_sink_ = nullptr;
 }
 
 
 /* CS6210_TASK Implement this function */
+/* The pair is copied into the arena and the partition buffer only gets a 16-byte record,
+	so a task emitting millions of pairs does no per-pair heap allocation */
 inline void BaseMapperInternal::emit(const std::string& key, const std::string& val) {
-	int reducer_id = get_hashed_val(key);
-	reducerBuffers[reducer_id].emplace_back(key, val);
-	buffered_words_count++;
+	if (key_sink_) {
+		key_sink_->push_back(key);
+		n_emitted_++;
+		return;
+	}
+
+	int reducer_id = get_partition(key);
+	append_(reducerBuffers[reducer_id], key, val);
+	n_emitted_++;
 
-	// if (buffered_words_count > 150) {
-	// 	save_as_files();
-	// 	buffered_words_count = 0;
-	// }
+	if (buffer_bytes_limit_ > 0 && buffered_bytes_ >= buffer_bytes_limit_) {
+		spill_();  // a failure is kept in error_ and fails the task in save_as_files
+	}
+}
+
+inline void BaseMapperInternal::append_(Buffer& buffer, std::string_view key, std::string_view val) {
+	buffer.push_back({arena_.append(key, val), static_cast<uint32_t>(key.size()), static_cast<uint32_t>(val.size())});
+	buffered_bytes_ += key.size() + val.size() + sizeof(Record);
 }
 
 inline int BaseMapperInternal::get_hashed_val(const std::string& key) {
 	return std::hash<std::string>{}(key)%n_output_;
 }
 
-inline void BaseMapperInternal::save_as_files() {
+inline int BaseMapperInternal::get_partition(const std::string& key) {
+	return partitioner_ ? partitioner_->partition(key) : get_hashed_val(key);
+}
+
+inline void BaseMapperInternal::set_partitioner(std::shared_ptr<Partitioner> partitioner) {
+	partitioner_ = std::move(partitioner);
+}
+
+inline void BaseMapperInternal::set_combiner(std::shared_ptr<BaseCombiner> combiner) {
+	combiner_ = std::move(combiner);
+}
+
+/* Runs the combiner on one key group, passing whatever it emits to sink */
+inline void BaseMapperInternal::combine_group_(const std::string& key, const std::vector<std::string>& values,
+		const BaseCombinerInternal::Sink& sink) {
+	combiner_->impl_->initialization(&sink);
+	combiner_->combine(key, values);
+	combiner_->impl_->initialization(nullptr);
+}
+
+/* Sorts a partition buffer by key and, if a combiner is set, replaces each key group with its output.
+	Combined pairs are appended to the arena; the records they replace stay there until it is cleared */
+inline void BaseMapperInternal::sort_and_combine_(Buffer& buffer) {
+	if (!runs_sorted_()) return;
+	auto by_key = [this](const Record& a, const Record& b) { return key_of_(a) < key_of_(b); };
+	std::stable_sort(buffer.begin(), buffer.end(), by_key);
+	if (!combiner_ || buffer.empty()) return;
+
+	Buffer combined;
+	const BaseCombinerInternal::Sink sink = [&](const std::string& k, const std::string& v) { append_(combined, k, v); };
+	size_t i = 0;
+	while (i < buffer.size()) {
+		const std::string_view key = key_of_(buffer[i]);
+		size_t j = i;
+		while (j < buffer.size() && key_of_(buffer[j]) == key) j++;
+
+		// the combiner API takes strings: materialize the group into reused ones
+		group_key_.assign(key);
+		group_values_.resize(j - i);
+		for (size_t k = i; k < j; k++) {
+			const std::string_view val = val_of_(buffer[k]);
+			group_values_[k - i].assign(val.data(), val.size());
+		}
+		combine_group_(group_key_, group_values_, sink);
+		i = j;
+	}
+
+	// a combiner is expected to keep its input key, but don't hand reducers an unsorted run if it didn't
+	if (!std::is_sorted(combined.begin(), combined.end(), by_key)) {
+		std::stable_sort(combined.begin(), combined.end(), by_key);
+	}
+	buffer.swap(combined);
+}
+
+/* Keeps the first failure for save_as_files to report; always false */
+inline bool BaseMapperInternal::fail_(const std::string& what) {
+	std::cerr << "[ERROR] Mapper " << mapper_id_ << ": " << what << std::endl;
+	if (error_.empty()) error_ = what;
+	return false;
+}
+
+inline bool BaseMapperInternal::write_run_(const std::string& path, IntermediateFormat format, const Buffer& buffer) {
+	IntermediateWriter writer;
+	if (!writer.open(path, format, runs_sorted_(), compression_)) {
+		return fail_("failed to open " + path);
+	}
+	for (const Record& r : buffer) {
+		writer.write(key_of_(r), val_of_(r));
+	}
+	if (!writer.close()) {
+		return fail_("failed to write " + path + ": " + std::strerror(errno));
+	}
+	return true;
+}
+
+/* Memory budget exceeded: write every partition buffer out as a sorted run and start over */
+inline bool BaseMapperInternal::spill_() {
+	bool ok = true;
 	for (int i = 0; i < n_output_; i++) {
-		std::string path = intermediate_file_dir_ + "/mapper_" + std::to_string(mapper_id_) + "_reducer_" + std::to_string(i) + ".txt";
-		std::ofstream file(path, std::ios::app);
-		if (!file.is_open()) {
-			std::cerr << "Failed to open file: " << path << std::endl;
-			continue;
+		auto& buffer = reducerBuffers[i];
+		if (buffer.empty()) continue;
+		sort_and_combine_(buffer);
+
+		// ".spillN" doesn't match is_intermediate_file_for(), so reducers never see a partial run
+		std::string path = intermediate_file_dir_ + "/" + intermediate_file_name(mapper_id_, i, IntermediateFormat::BINARY)
+			+ ".spill" + std::to_string(n_spills_);
+		ok = write_run_(path, IntermediateFormat::BINARY, buffer) && ok;
+
+		spill_runs_[i].push_back(path);
+		buffer.clear();
+	}
+	arena_.clear();
+	n_spills_++;
+	buffered_bytes_ = 0;
+	return ok;
+}
+
+/* k-way merges all spilled runs of one partition into its final intermediate file, combining across runs.
+	Unsorted spills just come out interleaved, which is all a hash reducer needs */
+inline bool BaseMapperInternal::merge_spills_(int reducer_id) {
+	std::string path = intermediate_file_dir_ + "/" + intermediate_file_name(mapper_id_, reducer_id, format_);
+	IntermediateMerger merger;
+	IntermediateWriter writer;
+	if (!merger.open(spill_runs_[reducer_id])) {
+		return fail_("failed to open the spills of partition " + std::to_string(reducer_id) +
+		             (merger.failed() ? ": " + merger.error() : ""));
+	}
+	if (!writer.open(path, format_, runs_sorted_(), compression_)) {
+		return fail_("failed to open " + path);
+	}
+
+	std::string key;
+	std::vector<std::string> values;
+	const BaseCombinerInternal::Sink sink = [&](const std::string& k, const std::string& v) { writer.write(k, v); };
+	while (merger.next_group(key, values)) {
+		if (combiner_ && values.size() > 1) {
+			combine_group_(key, values, sink);
+		} else {
+			for (const auto& v : values) writer.write(key, v);
 		}
+	}
+	const bool written = writer.close();
+	if (merger.failed()) {
+		return fail_(merger.error());
+	}
+	if (!written) {
+		return fail_("failed to write " + path + ": " + std::strerror(errno));
+	}
 
-		for (const auto& [key, val] : reducerBuffers[i]) {
-			file << key << ", " << val << "\n";
+	for (const auto& run : spill_runs_[reducer_id]) {
+		std::filesystem::remove(run);
+	}
+	spill_runs_[reducer_id].clear();
+	return true;
+}
+
+/* Writes each partition as one key-sorted run, so reducers can merge instead of re-sort.
+	If the task spilled, the in-memory tail is spilled too and all runs are merged per partition */
+inline bool BaseMapperInternal::save_as_files() {
+	if (!error_.empty()) return false;  // a spill already failed, a partition's data is gone
+
+	if (n_spills_ > 0) {
+		if (!spill_()) return false;
+		for (int i = 0; i < n_output_; i++) {
+			if (!merge_spills_(i)) return false;
 		}
-		
-		file.flush();
-		reducerBuffers[i].clear();
+		return true;
+	}
+
+	bool ok = true;
+	for (int i = 0; i < n_output_ && ok; i++) {
+		auto& buffer = reducerBuffers[i];
+		sort_and_combine_(buffer);
+		ok = write_run_(intermediate_file_dir_ + "/" + intermediate_file_name(mapper_id_, i, format_), format_, buffer);
+		buffer.clear();
 	}
+	arena_.clear();
+	buffered_bytes_ = 0;
+	return ok;
 }
 
+inline void BaseMapperInternal::reset() {
+	for (auto& buffer : reducerBuffers) {
+		if (buffer.capacity() * sizeof(Record) > MAX_RETAINED_BYTES) {
+			Buffer().swap(buffer);
+		} else {
+			buffer.clear();
+		}
+	}
+	if (arena_.capacity() > MAX_RETAINED_ARENA_BYTES) {
+		arena_.release();
+	} else {
+		arena_.clear();
+	}
+	for (auto& runs : spill_runs_) runs.clear();
+	error_.clear();
+	group_values_.clear();
+	buffered_bytes_ = 0;
+	buffer_bytes_limit_ = 0;
+	n_spills_ = 0;
+	n_emitted_ = 0;
+	sort_runs_ = true;
+	partitioner_.reset();
+	key_sink_ = nullptr;
+	line_buffer.clear();
+}
 
 
 /* CS6210_TASK Implement this function */
-inline void BaseMapperInternal::initialization(const int mapper_id, const std::string& intermediate_file_dir, const int n_output) {
+inline void BaseMapperInternal::initialization(const int mapper_id, const std::string& intermediate_file_dir, const int n_output,
+		const IntermediateFormat format, const size_t buffer_bytes, const Compression compression) {
 	mapper_id_ = mapper_id;
     intermediate_file_dir_ = intermediate_file_dir;
     n_output_ = n_output;
+	format_ = format;
+	compression_ = compression;
+	buffer_bytes_limit_ = buffer_bytes;
 	reducerBuffers.resize(n_output_);
+	spill_runs_.resize(n_output_);
 
 }
 
@@ -104,15 +428,39 @@ struct BaseReducerInternal {
 
 		// TODO 
 		// 
-		std::map<std::string, std::string> outputs;
 
-		void initialization(const int reducer_id, const std::string& output_dir);
+		/* Opens the output for emit. It is written to "output_<n>.txt.<attempt_id>.tmp", which the master
+			renames to output_<n>.txt if this attempt wins */
+		void initialization(const int reducer_id, const std::string& output_dir,
+				Compression compression = Compression::NONE, int64_t attempt_id = 0);
+
+		/* Flushes and closes the output; false if it could not be written. The output is left at
+			attempt_file() for the master to commit */
+		bool save_as_file();
+		const std::string& attempt_file() const { return attempt_file_; }
+
+		/* While set, emitted pairs go to side_run instead of the output (partials of a split hot key) */
+		void divert_to(IntermediateWriter* side_run) { divert_ = side_run; }
+
+		/* Copies a line of a committed output into this one (the split key merge rewriting a home partition) */
+		void copy_line(std::string_view line) { writer_.write_line(line); }
+
+		/* "output_<reducer_id>.txt", with ".lz4" appended when compressed */
+		std::string output_path() const;
+
+		/* Drops an uncommitted output and the counters before a pooled reducer takes its next task */
+		void reset() { writer_.abort(); attempt_file_.clear(); n_emitted_ = 0; divert_ = nullptr; }
 
-		void save_as_file();
+		size_t n_emitted() const { return n_emitted_; }
 	
 	private:
+		size_t n_emitted_ = 0;
+		IntermediateWriter* divert_ = nullptr;
 		int reducer_id_;
     	std::string output_dir_;
+		Compression compression_ = Compression::NONE;
+		OutputWriter writer_;
+		std::string attempt_file_;
 };
 
 
@@ -131,44 +479,32 @@ inline BaseReducerInternal::BaseReducerInternal() {
  * key: "<reducer_id>:bear"
  */
 inline void BaseReducerInternal::emit(const std::string& key, const std::string& val) {
-	outputs[key] =  val;
-
-	// if (outputs.size() > 50) {
-	// 	save_as_file();
-	// }
-
+	n_emitted_++;
+	if (divert_) {
+		divert_->write(key, val);
+		return;
+	}
+	writer_.write(key, val);
 }
 
-inline void BaseReducerInternal::initialization(const int reducer_id, const std::string& output_dir) {
+inline void BaseReducerInternal::initialization(const int reducer_id, const std::string& output_dir,
+		Compression compression, int64_t attempt_id) {
 	reducer_id_ = reducer_id;
 	output_dir_ = output_dir;
+	compression_ = compression;
 
-	std::string path = output_dir_ + "/output_" + std::to_string(reducer_id_) + ".txt";
-
-	if (std::filesystem::exists(path)) {
-        // Open in trunc mode to clear contents
-        std::ofstream ofs(path, std::ios::trunc);
-        if (!ofs) {
-        std::cerr << "Failed to open file for truncating.\n";
-        }
+	const std::string path = output_path();
+	if (!writer_.open(path, path + "." + std::to_string(attempt_id) + ".tmp", compression)) {
+		std::cerr << "Failed to open output for reducer " << reducer_id << std::endl;
 	}
 }
 
-inline void BaseReducerInternal::save_as_file() {
-
-	std::string path = output_dir_ + "/output_" + std::to_string(reducer_id_) + ".txt";
-	std::ofstream file(path, std::ios::app);
-	if (!file.is_open()) {
-		std::cerr << "Failed to open file: " << path << std::endl;
-		return;
-	}
-
-	for (const auto& [key, val] : outputs) {
-		file << key << " " << val << "\n";
-	}
-		
-	file.flush();
-	outputs.clear();
-	
+inline std::string BaseReducerInternal::output_path() const {
+	return output_dir_ + "/output_" + std::to_string(reducer_id_) + ".txt"
+		+ (compression_ == Compression::LZ4 ? ".lz4" : "");
 }
 
+inline bool BaseReducerInternal::save_as_file() {
+	attempt_file_.clear();
+	return writer_.close(&attempt_file_);
+}
@@ -0,0 +1,188 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "intermediate_io.h"
+
+
+/* Buffered writer for a reducer's output file. "key value" lines are collected in a buffer that is
+	written out every FLUSH_BYTES, so a reducer holds one buffer of output rather than all of it.
+	Compressed, the file is one LZ4 frame. The output goes to a temp file next to the final one, which
+	close() leaves in place; it becomes output_<n>.txt only when the master renames it, so the output
+	is never a partial file or a mix of two attempts */
+class OutputWriter {
+
+	public:
+		OutputWriter() = default;
+		~OutputWriter() { abort(); }
+		OutputWriter(const OutputWriter&) = delete;
+		OutputWriter& operator=(const OutputWriter&) = delete;
+
+		/* Starts a new output for path; the data goes to tmp_path */
+		bool open(const std::string& path, const std::string& tmp_path, Compression compression);
+
+		void write(std::string_view key, std::string_view val) {
+			buf_.append(key).append(" ").append(val).append("\n");
+			if (buf_.size() >= FLUSH_BYTES) flush_();
+		}
+
+		/* Writes a line read back from another output as is */
+		void write_line(std::string_view line) {
+			buf_.append(line).append("\n");
+			if (buf_.size() >= FLUSH_BYTES) flush_();
+		}
+
+		/* Flushes, syncs and closes the file; false if any write failed. The output stays at its temp
+			path, which is handed to the caller in tmp and no longer removed by abort() */
+		bool close(std::string* tmp = nullptr);
+		/* Closes the file and removes the temp file, if any */
+		void abort();
+
+		bool is_open() const { return out_.is_open(); }
+		const std::string& tmp_path() const { return tmp_path_; }
+
+		static constexpr size_t FLUSH_BYTES = 1 << 20;
+
+	private:
+		void flush_();
+
+		std::ofstream                   out_;
+		std::unique_ptr<Lz4FrameWriter> lz4_;
+		std::string                     buf_;
+		std::string                     tmp_path_;  // empty once closed
+};
+
+
+inline bool OutputWriter::open(const std::string& path, const std::string& tmp_path, Compression compression) {
+	abort();
+	tmp_path_ = tmp_path;
+	out_.open(tmp_path_, std::ios::binary | std::ios::trunc);
+	if (!out_.is_open()) {
+		std::cerr << "Failed to open file: " << tmp_path_ << " (for " << path << ")" << std::endl;
+		tmp_path_.clear();
+		return false;
+	}
+	if (compression == Compression::LZ4) lz4_ = std::make_unique<Lz4FrameWriter>(out_);
+	buf_.reserve(FLUSH_BYTES + 4096);
+	return true;
+}
+
+inline void OutputWriter::flush_() {
+	if (lz4_) lz4_->write(buf_.data(), buf_.size());
+	else      out_.write(buf_.data(), static_cast<std::streamsize>(buf_.size()));
+	buf_.clear();
+}
+
+inline bool OutputWriter::close(std::string* tmp) {
+	if (!out_.is_open()) return false;
+	flush_();
+	if (lz4_) lz4_->finish();
+	lz4_.reset();
+	out_.close();
+	bool ok = !out_.fail();
+	out_.clear();
+
+	// synced here, so that the rename that commits it can never expose a file still in the page cache
+	const int fd = ::open(tmp_path_.c_str(), O_RDONLY);
+	if (fd < 0 || ::fsync(fd) != 0) ok = false;
+	if (fd >= 0) ::close(fd);
+
+	if (!ok) {
+		abort();
+		return false;
+	}
+	if (tmp) *tmp = tmp_path_;
+	tmp_path_.clear();
+	return true;
+}
+
+inline void OutputWriter::abort() {
+	buf_.clear();
+	lz4_.reset();
+	if (out_.is_open()) out_.close();
+	out_.clear();
+	if (!tmp_path_.empty()) std::remove(tmp_path_.c_str());
+	tmp_path_.clear();
+}
+
+
+/* Reads a committed output file back line by line, decompressing an LZ4 one; the split key merge
+	rewrites home partitions through it */
+class OutputReader {
+
+	public:
+		bool open(const std::string& path, Compression compression);
+
+		/* Next line, without its '\n'; false at the end of the file or on an error (see failed()) */
+		bool next(std::string& line);
+
+		bool failed() const { return failed_; }
+		uint64_t bytes_read() const { return lz4_ ? lz4_->bytes_consumed() : bytes_read_; }
+
+	private:
+		bool fill_();
+
+		std::ifstream                   in_;
+		std::unique_ptr<Lz4FrameReader> lz4_;
+		std::string                     buf_;
+		size_t                          pos_ = 0;
+		uint64_t                        bytes_read_ = 0;
+		bool                            failed_ = false;
+
+		static constexpr size_t READ_BYTES = 1 << 16;
+};
+
+
+inline bool OutputReader::open(const std::string& path, Compression compression) {
+	in_.open(path, std::ios::binary);
+	if (!in_.is_open()) {
+		std::cerr << "Failed to open file: " << path << std::endl;
+		return false;
+	}
+	if (compression == Compression::LZ4) lz4_ = std::make_unique<Lz4FrameReader>(in_);
+	return true;
+}
+
+/* Appends the next chunk of the file to buf_; false at the end or on a decode error */
+inline bool OutputReader::fill_() {
+	buf_.erase(0, pos_);
+	pos_ = 0;
+	const size_t old = buf_.size();
+	buf_.resize(old + READ_BYTES);
+	size_t n;
+	if (lz4_) {
+		n = lz4_->read(&buf_[old], READ_BYTES);
+		if (lz4_->failed()) failed_ = true;
+	} else {
+		in_.read(&buf_[old], static_cast<std::streamsize>(READ_BYTES));
+		n = static_cast<size_t>(in_.gcount());
+		if (in_.bad()) failed_ = true;
+		bytes_read_ += n;
+	}
+	buf_.resize(old + n);
+	return n > 0 && !failed_;
+}
+
+inline bool OutputReader::next(std::string& line) {
+	size_t nl;
+	while ((nl = buf_.find('\n', pos_)) == std::string::npos) {
+		if (fill_()) continue;
+		if (failed_ || pos_ == buf_.size()) return false;
+		nl = buf_.size();  // last line without a '\n'
+		break;
+	}
+	line.assign(buf_, pos_, nl - pos_);
+	pos_ = std::min(nl + 1, buf_.size());
+	return true;
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+
+/* Picks the reducer partition of every key a mapper emits */
+class Partitioner {
+
+	public:
+		virtual ~Partitioner() = default;
+		virtual int partition(const std::string& key) = 0;
+};
+
+
+/* Default: std::hash of the key modulo the partition count */
+class HashPartitioner : public Partitioner {
+
+	public:
+		explicit HashPartitioner(int n_partitions) : n_partitions_(n_partitions) {}
+
+		int partition(const std::string& key) override {
+			return std::hash<std::string>{}(key) % n_partitions_;
+		}
+
+	private:
+		int n_partitions_;
+};
+
+
+/* Partition i holds the keys in [boundaries[i-1], boundaries[i]). Reducers see their keys in order,
+	so output_0.txt, output_1.txt, ... concatenate into one globally sorted result */
+class RangePartitioner : public Partitioner {
+
+	public:
+		explicit RangePartitioner(std::vector<std::string> boundaries) : boundaries_(std::move(boundaries)) {}
+
+		int partition(const std::string& key) override {
+			return static_cast<int>(std::upper_bound(boundaries_.begin(), boundaries_.end(), key) - boundaries_.begin());
+		}
+
+	private:
+		std::vector<std::string> boundaries_;  // sorted, n_partitions - 1 entries at most
+};
+
+
+/* Spreads the records of a few hot keys round-robin over several partitions and sends every other key
+	to the wrapped partitioner. A split key is reduced once per partition, so it is only valid for
+	reducers whose output can be fed back into reduce (sums, max, ...) */
+class HotKeySplitter : public Partitioner {
+
+	public:
+		explicit HotKeySplitter(std::shared_ptr<Partitioner> inner) : inner_(std::move(inner)) {}
+
+		void add_hot_key(const std::string& key, std::vector<int> partitions) {
+			if (!partitions.empty()) hot_[key].partitions = std::move(partitions);
+		}
+
+		int partition(const std::string& key) override {
+			auto it = hot_.find(key);
+			if (it == hot_.end()) return inner_->partition(key);
+			HotKey& hk = it->second;
+			return hk.partitions[hk.next++ % hk.partitions.size()];
+		}
+
+	private:
+		struct HotKey {
+			std::vector<int> partitions;
+			size_t           next = 0;
+		};
+
+		std::shared_ptr<Partitioner>             inner_;
+		std::unordered_map<std::string, HotKey>  hot_;
+};
+
+
+/* n_partitions - 1 boundaries at evenly spaced quantiles of the sampled keys (sorted in place).
+	Duplicates are dropped, so a sample dominated by a few keys yields fewer, still non-empty ranges */
+inline std::vector<std::string> range_boundaries_from_sample(std::vector<std::string>& keys, int n_partitions) {
+	std::vector<std::string> boundaries;
+	if (keys.empty() || n_partitions < 2) return boundaries;
+
+	std::sort(keys.begin(), keys.end());
+	for (int i = 1; i < n_partitions; ++i) {
+		const std::string& b = keys[keys.size() * i / n_partitions];
+		if (boundaries.empty() || boundaries.back() < b) boundaries.push_back(b);
+	}
+	return boundaries;
+}
+
+/* Keys making up more than `share` of the sample, most frequent first */
+inline std::vector<std::string> hot_keys_from_sample(const std::vector<std::string>& keys, double share) {
+	std::unordered_map<std::string, size_t> counts;
+	for (const auto& k : keys) counts[k]++;
+
+	std::vector<std::pair<size_t, std::string>> hot;
+	for (auto& [k, c] : counts) {
+		if (c > share * keys.size()) hot.emplace_back(c, k);
+	}
+	std::sort(hot.begin(), hot.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+
+	std::vector<std::string> out;
+	for (auto& [c, k] : hot) out.push_back(std::move(k));
+	return out;
+}
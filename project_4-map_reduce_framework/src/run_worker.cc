@@ -3,14 +3,18 @@
 
 int main(int argc, char** argv) {
 	std::string ip_addr_port;
-		if (argc == 2) {
+	int n_slots = 1;
+	std::string local_dir;
+		if (argc >= 2 && argc <= 4) {
 			ip_addr_port = std::string(argv[1]);
+			if (argc >= 3) n_slots = std::atoi(argv[2]);
+			if (argc == 4) local_dir = std::string(argv[3]);
 		}
 		else {
-			std::cerr << "Correct usage: [$binary_name $ip_addr_port], example: [./mr_worker localhost:50051]" << std::endl;
+			std::cerr << "Correct usage: [$binary_name $ip_addr_port [$n_slots [$local_dir]]], example: [./mr_worker localhost:50051 8 /tmp/mr_worker_50051]" << std::endl;
 			return EXIT_FAILURE;
 		}
 
-	Worker worker(ip_addr_port);
+	Worker worker(ip_addr_port, n_slots, local_dir);
 	return worker.run() ? EXIT_SUCCESS : EXIT_FAILURE;
 }
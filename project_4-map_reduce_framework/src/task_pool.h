@@ -0,0 +1,92 @@
+// task_pool.h
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/* Worker-local pool of user task objects (mappers, reducers), keyed by user_id. A task leases an
+	instance, and on return it is reset and kept for the next task of the same user instead of going
+	back through the task factory. Pooled objects are assumed to carry no per-task state of their own
+	beyond what reset clears, which holds for the BaseMapper/BaseReducer subclasses in this project */
+template <typename T>
+class TaskPool {
+
+	public:
+		using Create = std::function<std::shared_ptr<T>(const std::string& user_id)>;
+		using Reset  = std::function<void(T&)>;
+
+		/* Owns one instance for the duration of a task, then hands it back to the pool */
+		class Lease {
+
+			public:
+				Lease() = default;
+				Lease(TaskPool* pool, std::string user_id, std::shared_ptr<T> obj)
+					: pool_(pool), user_id_(std::move(user_id)), obj_(std::move(obj)) {}
+				Lease(Lease&& other) noexcept = default;
+				Lease& operator=(Lease&& other) noexcept { release(); pool_ = other.pool_; user_id_ = std::move(other.user_id_); obj_ = std::move(other.obj_); return *this; }
+				Lease(const Lease&) = delete;
+				Lease& operator=(const Lease&) = delete;
+				~Lease() { release(); }
+
+				T* operator->() const { return obj_.get(); }
+				T& operator*() const { return *obj_; }
+				explicit operator bool() const { return obj_ != nullptr; }
+
+				void release() {
+					if (pool_ && obj_) pool_->release_(user_id_, std::move(obj_));
+					obj_.reset();
+				}
+
+			private:
+				TaskPool*          pool_ = nullptr;
+				std::string        user_id_;
+				std::shared_ptr<T> obj_;
+		};
+
+		/* max_idle: instances kept per user_id; more than the worker's slot count is never needed */
+		TaskPool(Create create, Reset reset, size_t max_idle)
+			: create_(std::move(create)), reset_(std::move(reset)), max_idle_(max_idle) {}
+
+		/* An idle instance if there is one, else a new one; empty if user_id has no registered task */
+		Lease acquire(const std::string& user_id) {
+			{
+				std::lock_guard<std::mutex> lk(mu_);
+				auto& idle = idle_[user_id];
+				if (!idle.empty()) {
+					auto obj = std::move(idle.back());
+					idle.pop_back();
+					n_reused_++;
+					return Lease(this, user_id, std::move(obj));
+				}
+			}
+			auto obj = create_(user_id);
+			if (!obj) return Lease();
+			std::lock_guard<std::mutex> lk(mu_);
+			n_created_++;
+			return Lease(this, user_id, std::move(obj));
+		}
+
+		size_t n_created() const { std::lock_guard<std::mutex> lk(mu_); return n_created_; }
+		size_t n_reused() const { std::lock_guard<std::mutex> lk(mu_); return n_reused_; }
+
+	private:
+		void release_(const std::string& user_id, std::shared_ptr<T> obj) {
+			reset_(*obj);
+			std::lock_guard<std::mutex> lk(mu_);
+			auto& idle = idle_[user_id];
+			if (idle.size() < max_idle_) idle.push_back(std::move(obj));
+		}
+
+		Create create_;
+		Reset  reset_;
+		size_t max_idle_;
+
+		mutable std::mutex mu_;
+		std::unordered_map<std::string, std::vector<std::shared_ptr<T>>> idle_;
+		size_t n_created_ = 0;
+		size_t n_reused_ = 0;
+};
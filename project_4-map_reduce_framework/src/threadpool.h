@@ -0,0 +1,80 @@
+// threadpool.h
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <queue>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <stdexcept>
+
+/* Fixed-size executor; the worker runs map/reduce tasks on it, one task per thread (= slot) */
+class threadpool {
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> tasks;
+    std::mutex queue_mutex;
+    std::condition_variable condition;
+    bool stop;
+
+    void worker();
+
+public:
+    threadpool(size_t max_threads);
+    ~threadpool();
+
+    size_t size() const { return workers.size(); }
+
+    template <typename F>
+    auto submit(F&& f) -> std::future<decltype(f())> {
+        using return_type = decltype(f());
+        auto task = std::make_shared<std::packaged_task<return_type()>>(std::forward<F>(f));
+        std::future<return_type> future = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            if (stop) {
+                throw std::runtime_error("submit on stopped threadpool");
+            }
+            tasks.emplace([task]() { (*task)(); });
+        }
+        condition.notify_one();
+        return future;
+    }
+};
+
+
+inline threadpool::threadpool(size_t max_threads) : stop(false) {
+    for (size_t i = 0; i < max_threads; ++i) {
+        workers.emplace_back(&threadpool::worker, this);
+    }
+}
+
+inline threadpool::~threadpool() {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        stop = true;
+    }
+    condition.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+inline void threadpool::worker() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            condition.wait(lock, [this] { return stop || !tasks.empty(); });
+            if (stop && tasks.empty()) {
+                return;
+            }
+            task = std::move(tasks.front());
+            tasks.pop();
+        }
+        task();
+    }
+}
@@ -10,8 +10,18 @@
 #include <fstream>
 #include <regex>
 #include <filesystem>
+#include <map>
 #include <unordered_map>
+#include <unordered_set>
 #include <random>
+#include <atomic>
+#include <mutex>
+#include <unistd.h>
+
+#include "threadpool.h"
+#include "mapped_file.h"
+#include "task_pool.h"
+#include "hash_aggregator.h"
 
 using grpc::Server;
 using grpc::ServerBuilder;
@@ -21,7 +31,18 @@ using grpc::Status;
 using masterworker::MasterWorker;
 using masterworker::MapRequest;
 using masterworker::ReduceRequest;
+using masterworker::PremergeRequest;
+using masterworker::MapOutputLocation;
+using masterworker::FetchRequest;
+using masterworker::FetchChunk;
+using masterworker::CleanupRequest;
+using masterworker::SampleRequest;
+using masterworker::SampleResponse;
 using masterworker::WorkerResponse;
+using masterworker::WorkerInfoRequest;
+using masterworker::WorkerInfoResponse;
+using masterworker::HeartbeatRequest;
+using masterworker::Heartbeat;
 
 
 std::vector<std::string> splitRegex(const std::string& input, const std::string& pattern) {
@@ -31,6 +52,33 @@ std::vector<std::string> splitRegex(const std::string& input, const std::string&
     return {it, end};
 }
 
+extern std::shared_ptr<BaseMapper> get_mapper_from_task_factory(const std::string& user_id);
+extern std::shared_ptr<BaseReducer> get_reducer_from_task_factory(const std::string& user_id);
+extern std::shared_ptr<BaseCombiner> get_combiner_from_task_factory(const std::string& user_id);
+
+/* Live counters of one running attempt, sampled by the heartbeat stream */
+struct TaskProgressCounters {
+	std::atomic<uint64_t> bytes_done{0};
+	std::atomic<uint64_t> bytes_total{0};
+	std::atomic<uint64_t> records_emitted{0};
+	ServerContext*        context = nullptr;  // the attempt's RPC; the master cancels it when another copy won
+
+	bool cancelled() const { return context && context->IsCancelled(); }
+};
+
+/* Thrown out of a task whose RPC was cancelled; its handler cleans up like after any failure */
+struct TaskCancelled : std::runtime_error {
+	TaskCancelled() : std::runtime_error("attempt cancelled by the master") {}
+};
+
+/* Thrown by collectRuns_ when map outputs it was given are gone or unreachable. The handler reports
+	them in WorkerResponse.lost_inputs, so the master re-runs their maps instead of blaming this worker */
+struct InputsLost : std::runtime_error {
+	InputsLost(std::vector<MapOutputLocation> lost, const std::string& what)
+		: std::runtime_error(what), inputs(std::move(lost)) {}
+	std::vector<MapOutputLocation> inputs;
+};
+
 /* CS6210_TASK: Handle all the task a Worker is supposed to do.
 	This is a big task for this project, will test your understanding of map reduce */
 	class Worker {
@@ -38,16 +86,104 @@ std::vector<std::string> splitRegex(const std::string& input, const std::string&
 		public:
 			/* DON'T change the function signature of this constructor */
 			Worker(std::string ip_addr_port);
+			Worker(std::string ip_addr_port, int n_slots, std::string local_dir = "");
 	
 			/* DON'T change this function's signature */
 			bool run();
-			void handleMapTask(const MapRequest* request, WorkerResponse* response);
-			void handleReduceTask(const ReduceRequest* request, WorkerResponse* response);
+			/* context, if given, is polled so that a cancelled attempt stops early */
+			void handleMapTask(const MapRequest* request, WorkerResponse* response, ServerContext* context = nullptr);
+			void handleReduceTask(const ReduceRequest* request, WorkerResponse* response, ServerContext* context = nullptr);
+			void handlePremergeTask(const PremergeRequest* request, WorkerResponse* response, ServerContext* context = nullptr);
+			void handleCleanup(const CleanupRequest* request, WorkerResponse* response);
+			bool handleSampleTask(const SampleRequest* request, SampleResponse* response);
+
+			/* Serves one partition of a local map output dir to a peer's reducer */
+			Status serveMapOutput(ServerContext* context, const FetchRequest* request, grpc::ServerWriter<FetchChunk>* writer);
+
+			/* Runs f on one of the worker's task slots and waits for it */
+			template <typename F>
+			void runInSlot(F&& f) { executor_->submit(std::forward<F>(f)).get(); }
+			/* Same, but skips f if context was cancelled while the task waited for a slot */
+			template <typename F>
+			Status runInSlot(ServerContext* context, F&& f) {
+				runInSlot([&] { if (!context->IsCancelled()) f(); });
+				return context->IsCancelled() ? Status(grpc::StatusCode::CANCELLED, "attempt cancelled") : Status::OK;
+			}
+			int nSlots() const { return static_cast<int>(executor_->size()); }
+
+			/* Snapshot of memory use and every running attempt's progress */
+			void fillHeartbeat(Heartbeat* heartbeat);
+
+			/* true if file is an input on this worker's own disk: a regular file under its local_dir. Without a
+				local_dir nothing is, since on a shared filesystem every worker can open every input */
+			bool isLocalInput(const std::string& file) const;
+
+			/* Mapper output files in a local intermediate dir, -1 if it does not exist */
+			int countMapOutputFiles(const std::string& dir) const;
 	
 	
 		private:
 			/* NOW you can add below, data members and member functions as per the need of your implementation*/
 			std::string ip_addr_port_;
+			std::string local_dir_;                 // where relative intermediate dirs live; "" = working dir
+			std::unique_ptr<threadpool> executor_;  // one thread per slot
+
+			std::string localPath_(const std::string& dir) const;
+			MasterWorker::Stub* peerStub_(const std::string& addr);
+
+			std::mutex peers_mu_;
+			std::unordered_map<std::string, std::unique_ptr<MasterWorker::Stub>> peers_;  // addr -> stub, for shuffle fetches
+
+			std::shared_ptr<TaskProgressCounters> beginProgress_(int64_t attempt_id, ServerContext* context = nullptr);
+			void endProgress_(int64_t attempt_id);
+			/* Held by a task handler: its attempt leaves the heartbeats however the handler returns */
+			struct ProgressScope {
+				Worker* worker;
+				int64_t attempt_id;
+				~ProgressScope() { worker->endProgress_(attempt_id); }
+			};
+			/* Held by a reduce handler: its attempt's shuffle staging dir is removed on return */
+			struct StagingScope {
+				std::string dir;
+				~StagingScope() { std::error_code ec; std::filesystem::remove_all(dir, ec); }
+			};
+
+			/* Final pass over the side runs of split hot keys: rewrites each home partition's output with their
+				results merged in, to attempt files the master commits. In sorted mode each split key goes in at
+				its key's place, so sorted outputs stay sorted; hash mode outputs have no order, and the split
+				keys are appended at the end */
+			void mergeSplitKeys_(const ReduceRequest* request, WorkerResponse* response, ServerContext* context);
+
+			/* This reducer's runs in inputs: local dirs are read in place, remote ones are fetched into staging_dir
+				in parallel. Run sizes (and fetched bytes) are added to progress->bytes_total. Throws InputsLost
+				listing every input whose dir is missing or whose fetch failed */
+			std::vector<std::string> collectRuns_(const google::protobuf::RepeatedPtrField<MapOutputLocation>& inputs,
+			                                      int reducer_id, const std::string& staging_dir, TaskProgressCounters* progress);
+			std::vector<std::string> fetchRuns_(const MapOutputLocation& input, int reducer_id, const std::string& staging_dir,
+			                                    size_t input_idx, TaskProgressCounters* progress);
+			/* reduce_mode=hash: reads the runs one after another into a HashAggregator and reduces its groups.
+				A table past max_bytes (0 = no limit) is written out as a key-sorted run "<spill_prefix>_<n>.bin"
+				and cleared; then nothing is reduced here and the spilled runs are returned for the sorted path */
+			std::vector<std::string> hashReduce_(const std::vector<std::string>& runs, BaseReducer& reducer,
+			                 const std::unordered_set<std::string>& split_keys, IntermediateWriter* split_run,
+			                 uint64_t max_bytes, const std::string& spill_prefix, Compression compression,
+			                 std::vector<std::string>& temp_runs, TaskProgressCounters* progress);
+			/* Merges runs in batches until at most MAX_MERGE_FANIN are left; the temp runs it writes are
+				"<tmp_prefix>_<pass>_<n>.bin" and appended to temp_runs so the caller can remove them */
+			void mergeDownToFanin_(std::vector<std::string>& runs, const std::string& tmp_prefix,
+			                       std::vector<std::string>& temp_runs, Compression compression);
+
+			std::mutex progress_mu_;
+			std::unordered_map<int64_t, std::shared_ptr<TaskProgressCounters>> progress_;  // attempt_id -> counters
+
+			// user mappers/reducers are reset and reused across tasks instead of rebuilt by the task factory
+			TaskPool<BaseMapper>  mapper_pool_;
+			TaskPool<BaseReducer> reducer_pool_;
+
+			static constexpr size_t MAX_MERGE_FANIN = 256; // runs a reducer keeps open at once
+			static constexpr int SHUFFLE_CHUNK_BYTES = 1 << 20;  // payload per FetchChunk, well under gRPC's 4 MB message cap
+			static constexpr size_t MAX_PARALLEL_FETCHES = 8;   // concurrent fetch streams per task
+			static constexpr uint64_t CANCEL_CHECK_LINES = 1024; // input lines (or key groups) between cancellation checks
 	
 	};
 
@@ -59,14 +195,64 @@ public:
 
 	Status assignMapTask(ServerContext* context, const MapRequest* request,
                          WorkerResponse* response) override {
-		worker_->handleMapTask(request, response);
-		return Status::OK;
+		return worker_->runInSlot(context, [&] { worker_->handleMapTask(request, response, context); });
 
     }
 
     Status assignReduceTask(ServerContext* context, const ReduceRequest* request,
                             WorkerResponse* response) override {
-		worker_->handleReduceTask(request, response);
+		return worker_->runInSlot(context, [&] { worker_->handleReduceTask(request, response, context); });
+    }
+
+    Status premergeReduceInputs(ServerContext* context, const PremergeRequest* request,
+                                WorkerResponse* response) override {
+		return worker_->runInSlot(context, [&] { worker_->handlePremergeTask(request, response, context); });
+    }
+
+    Status fetchMapOutput(ServerContext* context, const FetchRequest* request,
+                          grpc::ServerWriter<FetchChunk>* writer) override {
+		// runs on a gRPC thread, not a task slot, so a worker busy with its own tasks still serves its outputs
+		return worker_->serveMapOutput(context, request, writer);
+    }
+
+    Status sampleKeys(ServerContext* context, const SampleRequest* request,
+                      SampleResponse* response) override {
+		bool ok = false;
+		worker_->runInSlot([&] { ok = worker_->handleSampleTask(request, response); });
+		return ok ? Status::OK : Status(grpc::StatusCode::NOT_FOUND, "no mapper registered for user_id: " + request->user_id());
+    }
+
+    Status cleanupIntermediate(ServerContext* context, const CleanupRequest* request,
+                               WorkerResponse* response) override {
+		worker_->handleCleanup(request, response);
+		return Status::OK;
+    }
+
+    Status getWorkerInfo(ServerContext* context, const WorkerInfoRequest* request,
+                         WorkerInfoResponse* response) override {
+		response->set_n_slots(worker_->nSlots());
+		for (const auto& file : request->input_files()) {
+			if (worker_->isLocalInput(file)) response->add_local_input_files(file);
+		}
+		for (const auto& dir : request->map_output_dirs()) {
+			response->add_map_output_files(worker_->countMapOutputFiles(dir));
+		}
+		return Status::OK;
+    }
+
+    Status heartbeat(ServerContext* context,
+                     grpc::ServerReaderWriter<Heartbeat, HeartbeatRequest>* stream) override {
+		HeartbeatRequest request;
+		if (!stream->Read(&request)) return Status::OK;
+		const auto interval = std::chrono::milliseconds(std::max(50, request.interval_ms()));
+
+		// runs on a gRPC thread, not a task slot, so a busy worker keeps reporting
+		while (!context->IsCancelled()) {
+			Heartbeat heartbeat;
+			worker_->fillHeartbeat(&heartbeat);
+			if (!stream->Write(heartbeat)) break;
+			std::this_thread::sleep_for(interval);
+		}
 		return Status::OK;
     }
 
@@ -79,12 +265,98 @@ public:
 
 /* CS6210_TASK: ip_addr_port is the only information you get when started.
 	You can populate your other class data members here if you want */
-	Worker::Worker(std::string ip_addr_port) : ip_addr_port_(ip_addr_port) {
+	Worker::Worker(std::string ip_addr_port) : Worker(ip_addr_port, 1) {}
+
+	Worker::Worker(std::string ip_addr_port, int n_slots, std::string local_dir)
+		: ip_addr_port_(ip_addr_port), local_dir_(local_dir), executor_(new threadpool(std::max(1, n_slots))),
+		  mapper_pool_(
+			[](const std::string& user_id) {
+				auto mapper = get_mapper_from_task_factory(user_id);
+				if (mapper) mapper->impl_->set_combiner(get_combiner_from_task_factory(user_id));
+				return mapper;
+			},
+			[](BaseMapper& mapper) { mapper.impl_->reset(); },
+			executor_->size()),
+		  reducer_pool_(
+			get_reducer_from_task_factory,
+			[](BaseReducer& reducer) { reducer.impl_->reset(); },
+			executor_->size()) {
 		// Store ip_addr_port into member variable
 	}
 
-extern std::shared_ptr<BaseMapper> get_mapper_from_task_factory(const std::string& user_id);
-extern std::shared_ptr<BaseReducer> get_reducer_from_task_factory(const std::string& user_id);
+/* Intermediate dirs from the master are relative to the worker's local dir, so workers sharing a host keep them apart */
+std::string Worker::localPath_(const std::string& dir) const {
+	if (local_dir_.empty() || std::filesystem::path(dir).is_absolute()) return dir;
+	return (std::filesystem::path(local_dir_) / dir).lexically_normal().string();
+}
+
+MasterWorker::Stub* Worker::peerStub_(const std::string& addr) {
+	std::lock_guard<std::mutex> lk(peers_mu_);
+	auto& stub = peers_[addr];
+	if (!stub) stub = MasterWorker::NewStub(grpc::CreateChannel(addr, grpc::InsecureChannelCredentials()));
+	return stub.get();
+}
+
+std::shared_ptr<TaskProgressCounters> Worker::beginProgress_(int64_t attempt_id, ServerContext* context) {
+	auto counters = std::make_shared<TaskProgressCounters>();
+	counters->context = context;
+	std::lock_guard<std::mutex> lk(progress_mu_);
+	progress_[attempt_id] = counters;
+	return counters;
+}
+
+void Worker::endProgress_(int64_t attempt_id) {
+	std::lock_guard<std::mutex> lk(progress_mu_);
+	progress_.erase(attempt_id);
+}
+
+void Worker::fillHeartbeat(Heartbeat* heartbeat) {
+	// resident set size = 2nd field of /proc/self/statm, in pages
+	std::ifstream statm("/proc/self/statm");
+	long pages_total = 0, pages_resident = 0;
+	if (statm >> pages_total >> pages_resident) {
+		heartbeat->set_rss_bytes(static_cast<int64_t>(pages_resident) * sysconf(_SC_PAGESIZE));
+	}
+	heartbeat->set_task_objects_created(static_cast<int64_t>(mapper_pool_.n_created() + reducer_pool_.n_created()));
+	heartbeat->set_task_objects_reused(static_cast<int64_t>(mapper_pool_.n_reused() + reducer_pool_.n_reused()));
+
+	std::lock_guard<std::mutex> lk(progress_mu_);
+	for (const auto& [attempt_id, counters] : progress_) {
+		auto* task = heartbeat->add_tasks();
+		task->set_attempt_id(attempt_id);
+		task->set_bytes_done(static_cast<int64_t>(counters->bytes_done.load(std::memory_order_relaxed)));
+		task->set_bytes_total(static_cast<int64_t>(counters->bytes_total.load(std::memory_order_relaxed)));
+		task->set_records_emitted(static_cast<int64_t>(counters->records_emitted.load(std::memory_order_relaxed)));
+	}
+}
+
+inline Compression to_compression(masterworker::CompressionType type) {
+	return type == masterworker::COMPRESSION_LZ4 ? Compression::LZ4 : Compression::NONE;
+}
+
+/* Partitioner described by a MapRequest; null for plain hashing, which the mapper does by itself */
+inline std::shared_ptr<Partitioner> make_partitioner(const masterworker::Partitioning& spec, int n_output) {
+	if (spec.type() == masterworker::PARTITIONER_HASH && spec.hot_keys_size() == 0) return nullptr;
+
+	std::shared_ptr<Partitioner> base;
+	if (spec.type() == masterworker::PARTITIONER_RANGE) {
+		base = std::make_shared<RangePartitioner>(
+			std::vector<std::string>(spec.range_boundaries().begin(), spec.range_boundaries().end()));
+	} else {
+		base = std::make_shared<HashPartitioner>(n_output);
+	}
+	if (spec.hot_keys_size() == 0) return base;
+
+	auto splitter = std::make_shared<HotKeySplitter>(base);
+	for (const auto& hk : spec.hot_keys()) {
+		std::vector<int> partitions;
+		for (int p : hk.partitions()) {
+			if (p >= 0 && p < n_output) partitions.push_back(p);
+		}
+		splitter->add_hot_key(hk.key(), std::move(partitions));
+	}
+	return splitter;
+}
 
 /* CS6210_TASK: Here you go. once this function is called your woker's job is to keep looking for new tasks 
 	from Master, complete when given one and again keep looking for the next one.
@@ -99,7 +371,7 @@ bool Worker::run() {
     builder.RegisterService(&service);
 
     std::unique_ptr<Server> server(builder.BuildAndStart());
-    std::cout << "Worker Server listening on " << ip_addr_port_ << std::endl;
+    std::cout << "Worker Server listening on " << ip_addr_port_ << " with " << nSlots() << " task slot(s)" << std::endl;
 
     server->Wait();
 
@@ -107,32 +379,55 @@ bool Worker::run() {
 	return true;
 }
 
-void Worker::handleMapTask(const MapRequest* request, WorkerResponse* response) {
+void Worker::handleMapTask(const MapRequest* request, WorkerResponse* response, ServerContext* context) {
 
-	// Randomly introduce a 10-second delay with 5% probability
+	// progress is reported by the heartbeat stream until this attempt returns
+	auto progress = beginProgress_(request->attempt_id(), context);
+	ProgressScope progress_scope{this, request->attempt_id()};
+	for (const auto& file : request->file_pieces()) {
+		progress->bytes_total += static_cast<uint64_t>(file.end_offset() - file.start_offset());
+	}
+
+	// Randomly introduce a 10-second delay with probability slow_probability
 	std::random_device rd;
 	std::mt19937 gen(rd());
 	std::uniform_real_distribution<> dis(0.0, 1.0);
 	
-	// simulating fault-injection (slow worker)
-	if (dis(gen) < 0.15) { // 10% probability
+	// simulating fault-injection (slow worker), slow_worker_probability in config.ini
+	if (dis(gen) < request->slow_probability()) {
 		std::cout << "[WORKER " << ip_addr_port_ << "] Simulating slow worker - sleeping for 10s" << std::endl;
-		std::this_thread::sleep_for(std::chrono::seconds(10));
+		for (int i = 0; i < 100 && !progress->cancelled(); ++i)
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
 	}
 
-	std::ifstream in;
-	auto mapper = get_mapper_from_task_factory("cs6210");
+	namespace fs = std::filesystem;
+	const std::string out_dir = localPath_(request->intermediate_file_dir());
+
+	MappedFile in;
+	const IntermediateFormat format = request->intermediate_format() == masterworker::INTERMEDIATE_TEXT
+		? IntermediateFormat::TEXT : IntermediateFormat::BINARY;
+	auto mapper = mapper_pool_.acquire(request->user_id());
+	if (!mapper) {
+		response->set_success(false);
+		response->set_output_files("");
+		response->set_error("No mapper registered for user_id: " + request->user_id());
+		return;
+	}
 	mapper->impl_->initialization(
 		request->mapper_id(),
-		request->intermediate_file_dir(),
-		request->n_output()
+		out_dir,
+		request->n_output(),
+		format,
+		static_cast<size_t>(request->buffer_bytes()),
+		to_compression(request->compression())
 	);
+	mapper->impl_->set_partitioner(make_partitioner(request->partitioning(), request->n_output()));
+	mapper->impl_->set_sort_runs(request->reduce_mode() != masterworker::REDUCE_HASH);
 
-	namespace fs = std::filesystem;
-	if (!fs::exists(request->intermediate_file_dir())) {
+	if (!fs::exists(out_dir)) {
         try {
-            fs::create_directories(request->intermediate_file_dir());  // creates all intermediate directories if needed
-            std::cout << "Created directory: " << request->intermediate_file_dir() << std::endl;
+            fs::create_directories(out_dir);  // creates all intermediate directories if needed
+            std::cout << "Created directory: " << out_dir << std::endl;
         } catch (const fs::filesystem_error& e) {
 			std::string error_msg = std::string("Failed to create directory: ") + e.what();
 			std::cerr << error_msg << std::endl;
@@ -144,19 +439,21 @@ void Worker::handleMapTask(const MapRequest* request, WorkerResponse* response)
     }
 
 	bool all_success = true;
+	bool cancelled = progress->cancelled();
 	std::ostringstream error_messages;
 
 	for (const auto& file : request->file_pieces()) {
-		in.open(file.file_path());
-		if (!in) {
+		if (cancelled) break;
+		if (!in.open(file.file_path())) {
 			all_success = false;
 			std::cerr << "[ERROR] Mapper task failed: failed to open " << file.file_path() << std::endl;
 			error_messages << "Failed to open file: " << file.file_path() << "\n";
 			continue;
 		}
 
-		in.seekg(file.start_offset());
-		if (!in) {
+		const size_t start_offset = static_cast<size_t>(file.start_offset());
+		const size_t end_offset   = static_cast<size_t>(file.end_offset());
+		if (file.start_offset() < 0 || start_offset > in.size()) {
 			all_success = false;
 			std::cerr << "[ERROR] Failed to seek to offset in " << file.file_path() << std::endl;
 			error_messages << "Failed to seek in file: " << file.file_path() << "\n";
@@ -164,25 +461,57 @@ void Worker::handleMapTask(const MapRequest* request, WorkerResponse* response)
 			continue;
 		}
 
+		// lines are slices of the mapping; only mappers that override map(const std::string&) pay for a copy.
+		// Every CANCEL_CHECK_LINES lines the attempt checks whether the master has given up on it
+		uint64_t n_lines = 0;
+		in.for_each_line(start_offset, end_offset, [&](std::string_view line) {
+			if (++n_lines % CANCEL_CHECK_LINES == 0 && progress->cancelled()) {
+				cancelled = true;
+				return false;
+			}
+			mapper->map_view(line);
+			progress->bytes_done.fetch_add(line.size() + 1, std::memory_order_relaxed);
+			progress->records_emitted.store(mapper->impl_->n_emitted(), std::memory_order_relaxed);
+			return true;
+		});
 
-		std::string line;
-		size_t current_shard_bytes = file.start_offset();
+		in.close();
+	}
 
-		while (current_shard_bytes < file.end_offset() && std::getline(in, line)) {
-			size_t line_size = line.size() + 1; // for '\n'
-			current_shard_bytes += line_size;
-			mapper->map(line);
-		}
+	if (cancelled) {
+		// the spills written so far are dropped with the dir; the pool resets the mapper on release
+		std::cout << "[WORKER " << ip_addr_port_ << "] map attempt " << request->attempt_id() << " cancelled" << std::endl;
+		std::error_code ec;
+		fs::remove_all(out_dir, ec);
+		response->set_success(false);
+		response->set_output_files("");
+		response->set_error(TaskCancelled().what());
+		return;
+	}
 
-		in.close();
+	if (!mapper->impl_->save_as_files()) {
+		// a partition file is missing or short: reducers must not see any of this attempt's output
+		std::cerr << "[ERROR] Mapper task failed: " << mapper->impl_->error() << std::endl;
+		std::error_code ec;
+		fs::remove_all(out_dir, ec);
+		response->set_success(false);
+		response->set_output_files("");
+		response->set_error("Failed to write intermediate files: " + mapper->impl_->error());
+		return;
 	}
 
-	mapper->impl_->save_as_files();
+	// per-partition sizes let the master report skew
+	for (int i = 0; i < request->n_output(); ++i) {
+		std::error_code ec;
+		auto size = fs::file_size(out_dir + "/" + intermediate_file_name(request->mapper_id(), i, format), ec);
+		response->add_partition_bytes(ec ? 0 : static_cast<int64_t>(size));
+	}
 
 	std::ostringstream output_files_stream;
 	for (int i = 0; i < request->n_output(); ++i) {
 		if (i > 0) output_files_stream << ",";
-		output_files_stream << request->intermediate_file_dir() + "/mapper_" + std::to_string(request->mapper_id()) + "_reducer_" + std::to_string(i) + ".txt";
+		output_files_stream << out_dir + "/"
+			+ intermediate_file_name(request->mapper_id(), i, format);
 	}
 
 	response->set_success(all_success);
@@ -191,17 +520,26 @@ void Worker::handleMapTask(const MapRequest* request, WorkerResponse* response)
 }
 
 
-void Worker::handleReduceTask(const ReduceRequest* request, WorkerResponse* response) {
+void Worker::handleReduceTask(const ReduceRequest* request, WorkerResponse* response, ServerContext* context) {
 
     namespace fs = std::filesystem;
 
+    if (request->merge_split_keys()) {
+        mergeSplitKeys_(request, response, context);
+        return;
+    }
+
     std::string user_id = request->user_id();
     int reducer_id = request->reducer_id();
     std::string output_dir = request->output_dir();
+    std::vector<std::string> temp_runs;
 
-    std::unordered_map<std::string, std::vector<std::string>> keyValues;
-    std::string target_suffix = "reducer_" + std::to_string(reducer_id) + ".txt";
+    auto progress = beginProgress_(request->attempt_id(), context);
+    ProgressScope progress_scope{this, request->attempt_id()};
 
+    // runs fetched from other workers land here and are dropped with the attempt
+    const std::string staging_dir = localPath_("./shuffle/attempt_" + std::to_string(request->attempt_id()));
+    StagingScope staging_scope{staging_dir};
 
     try {
 		if (!fs::exists(request->output_dir())) {
@@ -209,65 +547,610 @@ void Worker::handleReduceTask(const ReduceRequest* request, WorkerResponse* resp
             std::cout << "Created directory: " << request->output_dir() << std::endl;
         }
 
-        // 1. Read all relevant intermediate files
-		std::vector<fs::directory_entry> entries;
-		for (const auto& dir: request->intermediate_file_dirs()){
-			for (const auto& entry : fs::directory_iterator(dir)) {
-				entries.push_back(entry);
-			}
-		}
-
-        for (const auto& entry : entries) {
-            if (entry.is_regular_file()) {
-                std::string filename = entry.path().filename().string();
-
-                if (filename.size() >= target_suffix.size() &&
-                    filename.compare(filename.size() - target_suffix.size(), target_suffix.size(), target_suffix) == 0) {
+        // 1. Collect this reducer's intermediate files (key-sorted runs unless reduce_mode=hash),
+        //    pulling the ones on other workers' disks over fetchMapOutput
+		std::vector<std::string> runs = collectRuns_(request->inputs(), reducer_id, staging_dir, progress.get());
+        const Compression run_compression = to_compression(request->intermediate_compression());
+        const bool hashed = request->reduce_mode() == masterworker::REDUCE_HASH;
 
-                    std::ifstream in(entry.path());
-                    if (!in) {
-                        std::cerr << "[ERROR] Failed to open intermediate file: " << entry.path() << "\n";
-                        continue;
-                    }
+        auto reducer = reducer_pool_.acquire(user_id);
+        if (!reducer) {
+            throw std::runtime_error("no reducer registered for user_id: " + user_id);
+        }
+        reducer->impl_->initialization(reducer_id, output_dir, to_compression(request->output_compression()),
+                                       request->attempt_id());
 
-                    std::string line;
-                    while (std::getline(in, line)) {
-                        size_t delim = line.find(",");
-                        if (delim == std::string::npos) continue;
+        // hot keys split over several partitions: this partition only saw part of their records,
+        // so their results go to a side run that the master has reduced once more at the end
+        const std::unordered_set<std::string> split_keys(request->split_keys().begin(), request->split_keys().end());
+        const std::string split_path = output_dir + "/" + split_run_name(reducer_id);
+        const std::string split_tmp  = split_path + "." + std::to_string(request->attempt_id()) + ".tmp";
+        IntermediateWriter split_run;
+        if (!split_keys.empty()) {
+            if (!split_run.open(split_tmp, IntermediateFormat::BINARY, true, run_compression)) {
+                throw std::runtime_error("failed to open " + split_tmp);
+            }
+            temp_runs.push_back(split_tmp);
+        }
 
-                        std::string key = line.substr(0, delim);
-                        std::string value = line.substr(delim + 1);
-                        if (!value.empty() && value[0] == ' ') value.erase(0, 1);  // trim space
+        if (hashed) {
+            // 2. Group the partition in a hash table and reduce it as is: no sort, no merge. A partition
+            //    too large for the table's budget is spilled as sorted runs, which take the sorted path
+            runs = hashReduce_(runs, *reducer, split_keys, &split_run, static_cast<uint64_t>(request->hash_max_bytes()),
+                               output_dir + "/.hash_spill_" + std::to_string(reducer_id) + "_" + std::to_string(request->attempt_id()),
+                               run_compression, temp_runs, progress.get());
+            if (!runs.empty()) {
+                std::cout << "[WORKER " << ip_addr_port_ << "] reducer " << reducer_id << ": hash table over "
+                          << request->hash_max_bytes() << " bytes, merging " << runs.size() << " spilled sorted run(s)" << std::endl;
+            }
+        }
+        if (!hashed || !runs.empty()) {
+            // 2. k-way merge the runs; only one key group is in memory at a time.
+            //    Too many runs to hold open at once are first merged in batches into temp runs
+            const uint64_t done_before = progress->bytes_done.load();
+            // attempt-scoped: a backup of this reducer merges into the same output dir at the same time
+            mergeDownToFanin_(runs, output_dir + "/.merge_" + std::to_string(reducer_id) + "_" + std::to_string(request->attempt_id()),
+                              temp_runs, run_compression);
 
-                        keyValues[key].push_back(value);
-                    }
+            IntermediateMerger merger;
+            if (!merger.open(runs)) {
+                throw std::runtime_error("failed to open intermediate files");
+            }
 
-                    in.close();
-                }
+            // 3. Run reducer logic, keys arrive in sorted order
+            std::string key;
+            std::vector<std::string> values;
+            uint64_t n_groups = 0;
+            while (merger.next_group(key, values)) {
+                if (++n_groups % CANCEL_CHECK_LINES == 0 && progress->cancelled()) throw TaskCancelled();
+                const bool split = split_keys.count(key) > 0;
+                if (split) reducer->impl_->divert_to(&split_run);
+                reducer->reduce(key, values);
+                if (split) reducer->impl_->divert_to(nullptr);
+                progress->bytes_done.store(done_before + merger.bytes_read(), std::memory_order_relaxed);
+                progress->records_emitted.store(reducer->impl_->n_emitted(), std::memory_order_relaxed);
             }
+            if (merger.failed()) throw std::runtime_error(merger.error());
         }
 
-        // 2. Sort keys (by inserting into std::map)
-        std::map<std::string, std::vector<std::string>> sortedKeyValues(keyValues.begin(), keyValues.end());
-
-        // 3. Run reducer logic
-        auto reducer = get_reducer_from_task_factory(user_id);
-        reducer->impl_->initialization(reducer_id, output_dir);
+        // 4. Leave the output (and side run) under attempt-scoped temp names; the master renames the
+        //    files of the one attempt it accepts and drops the others, so a second copy never touches them
+        if (!reducer->impl_->save_as_file()) {
+            throw std::runtime_error("failed to write output_" + std::to_string(reducer_id));
+        }
+        std::vector<std::string> attempt_files{reducer->impl_->attempt_file()};
+        temp_runs.push_back(attempt_files.back());  // removed again if this attempt fails from here on
 
-        for (const auto& [key, values] : sortedKeyValues) {
-            reducer->reduce(key, values);
+        if (!split_keys.empty()) {
+            if (!split_run.close()) {
+                throw std::runtime_error("failed to write " + split_tmp);
+            }
+            attempt_files.push_back(split_tmp);
         }
 
-        reducer->impl_->save_as_file();
+        std::string output_files;
+        for (const auto& run : temp_runs) {
+            if (std::find(attempt_files.begin(), attempt_files.end(), run) == attempt_files.end()) fs::remove(run);
+        }
+        for (const auto& file : attempt_files) {
+            output_files += (output_files.empty() ? "" : ",") + file;
+        }
 
         response->set_success(true);
-        response->set_output_files("");
+        response->set_output_files(output_files);
         response->set_error("");
 
 
     } catch (const std::exception& ex) {
         std::cerr << "[ERROR] Reduce task failed: " << ex.what() << std::endl;
+        std::error_code ec;
+        for (const auto& run : temp_runs) {
+            fs::remove(run, ec);
+        }
+        if (const auto* lost = dynamic_cast<const InputsLost*>(&ex)) {
+            for (const auto& input : lost->inputs) *response->add_lost_inputs() = input;
+        }
         response->set_success(false);
         response->set_error(std::string("Reduce task failed: ") + ex.what());
     }
 }
+
+
+/* Groups are reduced in first-seen order and their values freed as they go. Split keys are held back and
+	reduced last in key order, since their side run is merged with the other partitions' sorted ones */
+std::vector<std::string> Worker::hashReduce_(const std::vector<std::string>& runs, BaseReducer& reducer,
+                         const std::unordered_set<std::string>& split_keys, IntermediateWriter* split_run,
+                         uint64_t max_bytes, const std::string& spill_prefix, Compression compression,
+                         std::vector<std::string>& temp_runs, TaskProgressCounters* progress) {
+	const uint64_t fetched = progress->bytes_done.load();
+	HashAggregator table;
+	uint64_t read = 0, n = 0;
+	std::string key, val;
+
+	std::vector<std::string> spills;
+	auto spill = [&] {
+		std::vector<HashAggregator::Group*> groups;
+		for (auto& group : table.groups()) groups.push_back(&group);
+		std::sort(groups.begin(), groups.end(), [](const auto* a, const auto* b) { return a->key < b->key; });
+		const std::string path = spill_prefix + "_" + std::to_string(spills.size()) + ".bin";
+		temp_runs.push_back(path);
+		IntermediateWriter out;
+		if (!out.open(path, IntermediateFormat::BINARY, true, compression)) {
+			throw std::runtime_error("failed to open " + path);
+		}
+		for (const auto* group : groups) {
+			for (const auto& v : group->values) out.write(group->key, v);
+		}
+		if (!out.close()) {
+			throw std::runtime_error("failed to write " + path);
+		}
+		std::error_code ec;
+		progress->bytes_total += std::filesystem::file_size(path, ec);  // read again by the merge
+		spills.push_back(path);
+		table.clear();
+	};
+
+	for (const auto& path : runs) {
+		IntermediateReader reader;
+		if (!reader.open(path)) {
+			throw std::runtime_error("failed to open intermediate file " + path);
+		}
+		while (reader.next(key, val)) {
+			table.add(key, val);
+			if (max_bytes > 0 && table.bytes() > max_bytes) spill();
+			if (++n % CANCEL_CHECK_LINES == 0) {
+				if (progress->cancelled()) throw TaskCancelled();
+				progress->bytes_done.store(fetched + read + reader.bytes_read(), std::memory_order_relaxed);
+			}
+		}
+		if (reader.failed()) throw std::runtime_error(reader.error());
+		read += reader.bytes_read();
+	}
+	progress->bytes_done.store(fetched + read, std::memory_order_relaxed);
+	if (!spills.empty()) {
+		if (table.size() > 0) spill();
+		return spills;
+	}
+
+	std::vector<HashAggregator::Group*> split;
+	n = 0;
+	for (auto& group : table.groups()) {
+		if (split_keys.count(group.key)) {
+			split.push_back(&group);
+			continue;
+		}
+		if (++n % CANCEL_CHECK_LINES == 0 && progress->cancelled()) throw TaskCancelled();
+		reducer.reduce(group.key, group.values);
+		std::vector<std::string>().swap(group.values);
+		progress->records_emitted.store(reducer.impl_->n_emitted(), std::memory_order_relaxed);
+	}
+
+	std::sort(split.begin(), split.end(), [](const auto* a, const auto* b) { return a->key < b->key; });
+	for (auto* group : split) {
+		reducer.impl_->divert_to(split_run);
+		reducer.reduce(group->key, group->values);
+		reducer.impl_->divert_to(nullptr);
+	}
+	return {};
+}
+
+std::vector<std::string> Worker::collectRuns_(const google::protobuf::RepeatedPtrField<MapOutputLocation>& inputs,
+                                              int reducer_id, const std::string& staging_dir, TaskProgressCounters* progress) {
+	namespace fs = std::filesystem;
+	std::vector<std::vector<std::string>> runs_per_input(inputs.size());
+	std::vector<int> remote;
+	std::vector<MapOutputLocation> lost;
+	std::string error;
+
+	for (int i = 0; i < inputs.size(); ++i) {
+		const auto& input = inputs[i];
+		if (!input.worker().empty() && input.worker() != ip_addr_port_) {
+			remote.push_back(i);
+			continue;
+		}
+		std::error_code ec;
+		for (const auto& entry : fs::directory_iterator(localPath_(input.dir()), ec)) {
+			if (entry.is_regular_file() && is_intermediate_file_for(entry.path().filename().string(), reducer_id)) {
+				runs_per_input[i].push_back(entry.path().string());
+				progress->bytes_total += entry.file_size();
+			}
+		}
+		if (ec) {
+			lost.push_back(input);
+			if (error.empty()) error = "cannot list " + input.dir() + ": " + ec.message();
+		}
+	}
+
+	// remote inputs: up to MAX_PARALLEL_FETCHES streams at once, each pulling whole dirs
+	if (!remote.empty()) {
+		fs::create_directories(staging_dir);
+		std::atomic<size_t> next{0};
+		std::atomic<bool> cancelled{false};
+		std::mutex err_mu;
+		bool failed = false;  // an error of this worker's own, not a lost input
+		std::vector<std::thread> fetchers;
+		for (size_t t = 0; t < std::min(MAX_PARALLEL_FETCHES, remote.size()); ++t) {
+			fetchers.emplace_back([&] {
+				for (size_t k = next++; k < remote.size() && !cancelled; k = next++) {
+					const int i = remote[k];
+					try {
+						runs_per_input[i] = fetchRuns_(inputs[i], reducer_id, staging_dir, i, progress);
+					} catch (const TaskCancelled&) {
+						cancelled = true;
+					} catch (const InputsLost& ex) {
+						std::lock_guard<std::mutex> lk(err_mu);
+						lost.insert(lost.end(), ex.inputs.begin(), ex.inputs.end());
+						if (error.empty()) error = ex.what();
+					} catch (const std::exception& ex) {
+						std::lock_guard<std::mutex> lk(err_mu);
+						if (!failed) error = ex.what();
+						failed = true;
+					}
+				}
+			});
+		}
+		for (auto& f : fetchers) f.join();
+		if (cancelled) throw TaskCancelled();
+		if (failed) throw std::runtime_error(error);
+	}
+	if (!lost.empty()) throw InputsLost(std::move(lost), error);
+
+	// keep input order, so values of equal keys are merged in the same order wherever the runs came from
+	std::vector<std::string> runs;
+	for (auto& r : runs_per_input) runs.insert(runs.end(), r.begin(), r.end());
+	return runs;
+}
+
+/* Streams one remote dir's files for reducer_id into staging_dir as "<input_idx>_<file name>".
+	gRPC's per-stream flow control keeps the sender from running ahead of the disk writes here */
+std::vector<std::string> Worker::fetchRuns_(const MapOutputLocation& input, int reducer_id, const std::string& staging_dir,
+                                            size_t input_idx, TaskProgressCounters* progress) {
+	FetchRequest request;
+	request.set_dir(input.dir());
+	request.set_reducer_id(reducer_id);
+	request.set_chunk_bytes(SHUFFLE_CHUNK_BYTES);
+
+	grpc::ClientContext ctx;
+	auto reader = peerStub_(input.worker())->fetchMapOutput(&ctx, request);
+
+	std::vector<std::string> runs;
+	std::ofstream out;
+	std::string current;
+	bool counted = false;
+	FetchChunk chunk;
+	while (reader->Read(&chunk)) {
+		if (progress->cancelled()) {
+			ctx.TryCancel();
+			reader->Finish();
+			throw TaskCancelled();
+		}
+		if (!counted) {
+			// fetched bytes are then read again by the merge, so they count twice towards the total
+			progress->bytes_total += 2 * static_cast<uint64_t>(chunk.total_bytes());
+			counted = true;
+		}
+		if (!out.is_open() || chunk.file_name() != current) {
+			if (out.is_open()) out.close();
+			current = chunk.file_name();
+			runs.push_back(staging_dir + "/" + std::to_string(input_idx) + "_" + current);
+			out.open(runs.back(), std::ios::binary | std::ios::trunc);
+			if (!out.is_open()) {
+				ctx.TryCancel();
+				reader->Finish();
+				throw std::runtime_error("failed to create " + runs.back());
+			}
+		}
+		out.write(chunk.data().data(), chunk.data().size());
+		progress->bytes_done += chunk.data().size();
+	}
+	if (out.is_open()) out.close();
+
+	grpc::Status status = reader->Finish();
+	if (!status.ok()) {
+		throw InputsLost({input}, "fetch of " + input.dir() + " from " + input.worker() + " failed: " + status.error_message());
+	}
+	return runs;
+}
+
+Status Worker::serveMapOutput(ServerContext* context, const FetchRequest* request, grpc::ServerWriter<FetchChunk>* writer) {
+	namespace fs = std::filesystem;
+	const std::string dir = localPath_(request->dir());
+
+	std::vector<fs::path> files;
+	uint64_t total = 0;
+	std::error_code ec;
+	for (const auto& entry : fs::directory_iterator(dir, ec)) {
+		if (entry.is_regular_file() && is_intermediate_file_for(entry.path().filename().string(), request->reducer_id())) {
+			files.push_back(entry.path());
+			total += entry.file_size();
+		}
+	}
+	if (ec) {
+		return Status(grpc::StatusCode::NOT_FOUND, "cannot list " + dir + ": " + ec.message());
+	}
+
+	const size_t chunk_bytes = static_cast<size_t>(
+		request->chunk_bytes() > 0 ? std::min(request->chunk_bytes(), SHUFFLE_CHUNK_BYTES) : SHUFFLE_CHUNK_BYTES);
+	std::vector<char> buf(chunk_bytes);
+
+	for (const auto& path : files) {
+		std::ifstream in(path, std::ios::binary);
+		if (!in.is_open()) {
+			return Status(grpc::StatusCode::INTERNAL, "cannot open " + path.string());
+		}
+		bool sent = false;
+		while (!sent || in) {
+			in.read(buf.data(), chunk_bytes);
+			if (in.gcount() == 0 && sent) break;
+			FetchChunk chunk;
+			chunk.set_file_name(path.filename().string());
+			chunk.set_data(buf.data(), static_cast<size_t>(in.gcount()));  // an empty file still gets one chunk
+			chunk.set_total_bytes(static_cast<int64_t>(total));
+			if (context->IsCancelled() || !writer->Write(chunk)) {
+				return Status(grpc::StatusCode::CANCELLED, "fetch cancelled by " + context->peer());
+			}
+			sent = true;
+		}
+	}
+	return Status::OK;
+}
+
+bool Worker::isLocalInput(const std::string& file) const {
+	namespace fs = std::filesystem;
+	std::error_code ec;
+	if (local_dir_.empty() || !fs::is_regular_file(file, ec)) return false;
+	const fs::path rel = fs::weakly_canonical(file, ec).lexically_relative(fs::weakly_canonical(local_dir_, ec));
+	return !ec && !rel.empty() && *rel.begin() != "..";
+}
+
+int Worker::countMapOutputFiles(const std::string& dir) const {
+	std::error_code ec;
+	int n = 0;
+	for (const auto& entry : std::filesystem::directory_iterator(localPath_(dir), ec)) {
+		if (entry.is_regular_file() && entry.path().filename().string().rfind("mapper_", 0) == 0) ++n;
+	}
+	return ec ? -1 : n;
+}
+
+void Worker::handleCleanup(const CleanupRequest* request, WorkerResponse* response) {
+	std::error_code ec;
+	std::filesystem::remove_all(localPath_(request->dir()), ec);
+	response->set_success(!ec);
+	response->set_error(ec ? ec.message() : "");
+}
+
+void Worker::mergeDownToFanin_(std::vector<std::string>& runs, const std::string& tmp_prefix,
+                               std::vector<std::string>& temp_runs, Compression compression) {
+	int n_passes = 0;
+	while (runs.size() > MAX_MERGE_FANIN) {
+		std::vector<std::string> merged;
+		for (size_t i = 0; i < runs.size(); i += MAX_MERGE_FANIN) {
+			std::vector<std::string> batch(runs.begin() + i, runs.begin() + std::min(runs.size(), i + MAX_MERGE_FANIN));
+			std::string out = tmp_prefix + "_" + std::to_string(n_passes) + "_" + std::to_string(merged.size()) + ".bin";
+			if (!merge_runs_to_file(batch, out, compression)) {
+				throw std::runtime_error("failed to pre-merge intermediate files into " + out);
+			}
+			merged.push_back(out);
+			temp_runs.push_back(out);
+		}
+		runs.swap(merged);
+		n_passes++;
+	}
+}
+
+
+/* Runs on an otherwise idle slot during the map phase: folds the given map outputs of one partition
+	into a single sorted run, so the reduce task that follows opens fewer, larger runs */
+void Worker::handlePremergeTask(const PremergeRequest* request, WorkerResponse* response, ServerContext* context) {
+
+	namespace fs = std::filesystem;
+
+	const int reducer_id = request->reducer_id();
+	const std::string output_dir = localPath_(request->output_dir());
+	const std::string out = output_dir + "/premerge_" + std::to_string(request->premerge_id())
+		+ "_reducer_" + std::to_string(reducer_id) + intermediate_file_ext(IntermediateFormat::BINARY);
+	std::vector<std::string> temp_runs;
+
+	auto progress = beginProgress_(request->attempt_id(), context);
+	ProgressScope progress_scope{this, request->attempt_id()};
+
+	const std::string staging_dir = localPath_("./shuffle/attempt_" + std::to_string(request->attempt_id()));
+	StagingScope staging_scope{staging_dir};
+
+	try {
+		fs::create_directories(output_dir);
+
+		std::vector<std::string> runs = collectRuns_(request->inputs(), reducer_id, staging_dir, progress.get());
+		if (progress->cancelled()) throw TaskCancelled();
+		const Compression compression = to_compression(request->compression());
+		mergeDownToFanin_(runs, output_dir + "/.merge_" + std::to_string(reducer_id) + "_" + std::to_string(request->attempt_id()),
+		                  temp_runs, compression);
+		if (!merge_runs_to_file(runs, out, compression)) {
+			throw std::runtime_error("failed to merge intermediate files into " + out);
+		}
+		progress->bytes_done.store(progress->bytes_total.load());
+
+		for (const auto& run : temp_runs) {
+			fs::remove(run);
+		}
+
+		std::cout << "[WORKER " << ip_addr_port_ << "] pre-merged " << request->inputs_size()
+		          << " map output(s) of reducer " << reducer_id << " into " << out << std::endl;
+		response->set_success(true);
+		response->set_output_files(out);
+		response->set_error("");
+
+	} catch (const std::exception& ex) {
+		std::cerr << "[ERROR] Pre-merge task failed: " << ex.what() << std::endl;
+		std::error_code ec;
+		for (const auto& run : temp_runs) {
+			fs::remove(run, ec);
+		}
+		fs::remove(out, ec);
+		if (const auto* lost = dynamic_cast<const InputsLost*>(&ex)) {
+			for (const auto& input : lost->inputs) *response->add_lost_inputs() = input;
+		}
+		response->set_success(false);
+		response->set_error(std::string("Pre-merge task failed: ") + ex.what());
+	}
+}
+
+
+void Worker::mergeSplitKeys_(const ReduceRequest* request, WorkerResponse* response, ServerContext* context) {
+
+	namespace fs = std::filesystem;
+
+	const std::string& output_dir = request->output_dir();
+	const Compression compression = to_compression(request->output_compression());
+	std::vector<std::string> attempt_files;
+	auto progress = beginProgress_(request->attempt_id(), context);
+	ProgressScope progress_scope{this, request->attempt_id()};
+
+	try {
+		std::unordered_map<std::string, int> home;
+		for (int i = 0; i < request->split_keys_size() && i < request->split_key_homes_size(); ++i) {
+			home[request->split_keys(i)] = request->split_key_homes(i);
+		}
+
+		std::vector<std::string> runs;
+		for (const auto& entry : fs::directory_iterator(output_dir)) {
+			if (entry.is_regular_file() && is_split_run(entry.path().filename().string())) {
+				runs.push_back(entry.path().string());
+				progress->bytes_total += entry.file_size();
+			}
+		}
+
+		// 1. Gather the partials of each split key by home partition. There are a few hot keys at most,
+		//    each with one partial per partition it was split over
+		using Group = std::pair<std::string, std::vector<std::string>>;
+		std::map<int, std::vector<Group>> by_home;
+		IntermediateMerger merger;
+		if (!merger.open(runs)) {
+			throw std::runtime_error("failed to open split key runs");
+		}
+		std::string key;
+		std::vector<std::string> values;
+		while (merger.next_group(key, values)) {
+			auto it = home.find(key);
+			if (it == home.end()) {
+				throw std::runtime_error("split key runs hold '" + key + "', which is not a split key of this job");
+			}
+			by_home[it->second].emplace_back(key, values);
+		}
+		if (merger.failed()) throw std::runtime_error(merger.error());
+		uint64_t read = merger.bytes_read();
+
+		auto reducer = reducer_pool_.acquire(request->user_id());
+		if (!reducer) {
+			throw std::runtime_error("no reducer registered for user_id: " + request->user_id());
+		}
+
+		// 2. Rewrite each home partition's output with the final results of its split keys merged in, in
+		//    key order (sorted mode) or after its last line (hash mode), under an attempt-scoped temp name.
+		//    The committed output is only read; the master renames the files of the attempt it accepts
+		//    over it, as for a reduce task
+		const bool in_key_order = request->reduce_mode() != masterworker::REDUCE_HASH;
+		for (auto& [h, groups] : by_home) {
+			if (progress->cancelled()) throw TaskCancelled();
+			reducer->impl_->initialization(h, output_dir, compression, request->attempt_id());
+			const std::string committed = reducer->impl_->output_path();
+			std::error_code ec;
+			progress->bytes_total += fs::file_size(committed, ec);
+
+			OutputReader in;
+			if (!in.open(committed, compression)) {
+				throw std::runtime_error("failed to open " + committed);
+			}
+			std::string line;
+			size_t g = 0;
+			uint64_t n_lines = 0;
+			while (in.next(line)) {
+				if (in_key_order) {
+					// a line is "<key> <value>"; split keys go in before the first line with a greater key
+					const std::string_view line_key = std::string_view(line).substr(0, line.find(' '));
+					for (; g < groups.size() && std::string_view(groups[g].first) < line_key; ++g) {
+						reducer->reduce(groups[g].first, groups[g].second);
+					}
+				}
+				reducer->impl_->copy_line(line);
+				if (++n_lines % CANCEL_CHECK_LINES == 0) {
+					if (progress->cancelled()) throw TaskCancelled();
+					progress->bytes_done.store(read + in.bytes_read(), std::memory_order_relaxed);
+				}
+			}
+			if (in.failed()) {
+				throw std::runtime_error("failed to read " + committed);
+			}
+			for (; g < groups.size(); ++g) {
+				reducer->reduce(groups[g].first, groups[g].second);
+			}
+			if (!reducer->impl_->save_as_file()) {
+				throw std::runtime_error("failed to write output_" + std::to_string(h));
+			}
+			attempt_files.push_back(reducer->impl_->attempt_file());
+			read += in.bytes_read();
+			progress->bytes_done.store(read, std::memory_order_relaxed);
+		}
+
+		// the side runs stay until the master has committed this attempt, a retry reads them again
+		std::string output_files;
+		for (const auto& file : attempt_files) {
+			output_files += (output_files.empty() ? "" : ",") + file;
+		}
+		response->set_success(true);
+		response->set_output_files(output_files);
+		response->set_error("");
+
+	} catch (const std::exception& ex) {
+		std::cerr << "[ERROR] Split key merge failed: " << ex.what() << std::endl;
+		std::error_code ec;
+		for (const auto& file : attempt_files) {
+			fs::remove(file, ec);
+		}
+		response->set_success(false);
+		response->set_error(std::string("Split key merge failed: ") + ex.what());
+	}
+}
+
+/* Runs the user's mapper over the first max_bytes of a shard, keeping a uniform reservoir of
+	the keys it emits; nothing is partitioned or written */
+bool Worker::handleSampleTask(const SampleRequest* request, SampleResponse* response) {
+	auto mapper = mapper_pool_.acquire(request->user_id());
+	if (!mapper) return false;
+
+	std::vector<std::string> emitted;
+	mapper->impl_->initialization(-1, "", 1);
+	mapper->impl_->set_key_sink(&emitted);
+
+	const size_t max_keys = static_cast<size_t>(std::max(1, request->max_keys()));
+	std::vector<std::string> reservoir;
+	std::mt19937_64 rng(request->max_bytes());  // fixed seed: the same shard yields the same sample
+	uint64_t seen = 0;
+	int64_t budget = request->max_bytes();
+
+	MappedFile in;
+	for (const auto& piece : request->file_pieces()) {
+		if (budget <= 0) break;
+		if (!in.open(piece.file_path())) continue;
+		const size_t start = static_cast<size_t>(std::max<int64_t>(0, piece.start_offset()));
+		const size_t end   = static_cast<size_t>(std::min<int64_t>(piece.end_offset(), piece.start_offset() + budget));
+		in.for_each_line(start, end, [&](std::string_view line) {
+			mapper->map_view(line);
+			for (auto& key : emitted) {
+				++seen;
+				if (reservoir.size() < max_keys) {
+					reservoir.push_back(std::move(key));
+				} else {
+					uint64_t j = rng() % seen;
+					if (j < max_keys) reservoir[j] = std::move(key);
+				}
+			}
+			emitted.clear();
+		});
+		budget -= static_cast<int64_t>(end > start ? end - start : 0);
+		in.close();
+	}
+
+	for (auto& key : reservoir) response->add_keys(std::move(key));
+	return true;
+}
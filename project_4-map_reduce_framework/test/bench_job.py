@@ -0,0 +1,171 @@
+#!/usr/bin/env python3
+"""Runs the word count job end to end on local workers and reports the phase times.
+
+The bundled test inputs are concatenated --scale times, N mr_worker processes are started on
+localhost (each with its own intermediate dir), and mrdemo runs with test/config.ini plus any
+--set overrides. The simulated slow worker stall is off unless --set slow_worker_probability=...
+turns it back on. The master's per-phase times are read from its log, and with --check the output
+is compared against the input's word counts.
+
+e.g.
+    test/bench_job.py --bin-dir build/bin --scale 1000 --set reduce_mode=sorted
+    test/bench_job.py --bin-dir build/bin --scale 1000 --set reduce_mode=hash
+    test/bench_job.py --bin-dir build/bin --workers 256 --set map_kilobytes=16
+"""
+
+import argparse
+import collections
+import os
+import re
+import socket
+import subprocess
+import sys
+import time
+from pathlib import Path
+
+TEST_DIR = Path(os.path.dirname(os.path.abspath(__file__)))
+INPUTS = ["testdata_1.txt", "testdata_2.txt", "testdata_3.txt"]
+DELIMS = re.compile(rb"[ ,.\"']+")
+
+
+class JobBench:
+    def __init__(self, args):
+        self.args = args
+        self.bin_dir = Path(args.bin_dir).resolve()
+        self.work_dir = Path(args.work_dir).resolve()
+        self.ports = [args.base_port + i for i in range(args.workers)]
+        self.workers = []
+
+    def make_inputs(self):
+        """Writes each test input repeated --scale times, unless a previous run left the same files"""
+        input_dir = self.work_dir / "input"
+        input_dir.mkdir(parents=True, exist_ok=True)
+        paths = []
+        for name in INPUTS:
+            data = (TEST_DIR / "input" / name).read_bytes()
+            if not data.endswith(b"\n"):
+                data += b"\n"
+            path = input_dir / name
+            if not path.exists() or path.stat().st_size != len(data) * self.args.scale:
+                with open(path, "wb") as f:
+                    for _ in range(self.args.scale):
+                        f.write(data)
+            paths.append(path)
+        total = sum(p.stat().st_size for p in paths)
+        print(f"inputs: {len(paths)} file(s), {total / 2**20:.1f} MB ({self.args.scale}x the test inputs)")
+        return paths
+
+    def write_config(self, inputs):
+        settings = collections.OrderedDict()
+        for line in (TEST_DIR / "config.ini").read_text().splitlines():
+            line = line.strip()
+            if line and not line.startswith(";") and "=" in line:
+                key, value = line.split("=", 1)
+                settings[key.strip()] = value.strip()
+        settings["n_workers"] = str(len(self.ports))
+        settings["worker_ipaddr_ports"] = ",".join(f"localhost:{p}" for p in self.ports)
+        settings["input_files"] = ",".join(str(p.relative_to(self.work_dir)) for p in inputs)
+        settings["output_dir"] = "output"
+        settings["slow_worker_probability"] = "0"  # no simulated 10 s stalls in the timings
+        for kv in self.args.set:
+            key, value = kv.split("=", 1)
+            settings[key.strip()] = value.strip()
+        with open(self.work_dir / "config.ini", "w") as f:
+            for key, value in settings.items():
+                f.write(f"{key}={value}\n")
+        return settings
+
+    def start_workers(self):
+        for port in self.ports:
+            local_dir = self.work_dir / "workers" / str(port)
+            local_dir.mkdir(parents=True, exist_ok=True)
+            log = open(self.work_dir / "workers" / f"{port}.log", "w")
+            cmd = [str(self.bin_dir / "mr_worker"), f"localhost:{port}", str(self.args.slots), str(local_dir)]
+            self.workers.append(subprocess.Popen(cmd, cwd=self.work_dir, stdout=log, stderr=subprocess.STDOUT))
+        # the master gives a worker 2 s to answer getWorkerInfo, so wait until every one listens
+        deadline = time.time() + 30 + len(self.ports) / 10
+        for port in self.ports:
+            while True:
+                try:
+                    socket.create_connection(("localhost", port), timeout=1).close()
+                    break
+                except OSError:
+                    if time.time() > deadline:
+                        sys.exit(f"worker on port {port} did not come up")
+                    time.sleep(0.05)
+        print(f"workers: {len(self.ports)} up, {self.args.slots} slot(s) each")
+
+    def stop_workers(self):
+        for proc in self.workers:
+            proc.terminate()
+        for proc in self.workers:
+            proc.wait()
+
+    def run_master(self):
+        start = time.time()
+        with open(self.work_dir / "master.log", "w") as log:
+            rc = subprocess.call([str(self.bin_dir / "mrdemo")], cwd=self.work_dir, stdout=log, stderr=subprocess.STDOUT)
+        elapsed = time.time() - start
+        text = (self.work_dir / "master.log").read_text(errors="replace")
+        phases = collections.defaultdict(int)
+        for name, ms in re.findall(r"\[MASTER\] (\w+) phase took (\d+) ms", text):
+            phases[name] += int(ms)
+        return rc, elapsed, phases
+
+    def check_output(self, inputs):
+        expected = collections.Counter()
+        for name in INPUTS:
+            for line in (TEST_DIR / "input" / name).read_bytes().split(b"\n"):
+                expected.update(t for t in DELIMS.split(line) if t)
+        for key in expected:
+            expected[key] *= self.args.scale
+        got = collections.Counter()
+        for path in (self.work_dir / "output").glob("output_*"):
+            with open(path, "rb") as f:
+                for line in f:
+                    key, _, value = line.rstrip(b"\n").rpartition(b" ")
+                    got[key] += int(value)
+        return expected == got, len(expected), len(got)
+
+    def run(self):
+        self.work_dir.mkdir(parents=True, exist_ok=True)
+        inputs = self.make_inputs()
+        settings = self.write_config(inputs)
+        print("settings: " + ", ".join(f"{k}={settings[k]}" for k in
+              ("map_kilobytes", "n_output_files", "reduce_mode", "intermediate_compression") if k in settings))
+        self.start_workers()
+        try:
+            rc, elapsed, phases = self.run_master()
+        finally:
+            self.stop_workers()
+        print(f"master: exit {rc}, {elapsed:.1f} s wall, log in {self.work_dir / 'master.log'}")
+        for name in ("MAP", "REDUCE", "SPLIT_MERGE"):
+            if name in phases:
+                print(f"  {name:<11} {phases[name]:>8} ms")
+        if rc != 0:
+            return rc
+        if self.args.check:
+            if settings.get("output_compression", "none") != "none":
+                print("check: skipped, output is compressed")
+            else:
+                ok, n_expected, n_got = self.check_output(inputs)
+                print(f"check: {'OK' if ok else 'MISMATCH'} ({n_got} of {n_expected} words)")
+                return 0 if ok else 1
+        return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--bin-dir", default=str(TEST_DIR.parent / "build" / "bin"), help="dir holding mrdemo and mr_worker")
+    parser.add_argument("--work-dir", default="/tmp/mr_bench", help="inputs, config, worker dirs and output go here")
+    parser.add_argument("--workers", type=int, default=6)
+    parser.add_argument("--slots", type=int, default=1, help="task slots per worker")
+    parser.add_argument("--base-port", type=int, default=50051)
+    parser.add_argument("--scale", type=int, default=1, help="times the test inputs are repeated")
+    parser.add_argument("--set", action="append", default=[], metavar="KEY=VALUE", help="config.ini override")
+    parser.add_argument("--check", action="store_true", help="compare the output against the input's word counts")
+    sys.exit(JobBench(parser.parse_args()).run())
+
+
+if __name__ == "__main__":
+    main()
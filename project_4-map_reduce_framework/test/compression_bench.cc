@@ -0,0 +1,188 @@
+/* Compression benchmark for intermediate files (intermediate_compression=lz4).
+
+	Tokenizes the bundled test inputs, repeated scale times, the way the reference word count mapper
+	does and writes the records as one map task's sorted intermediates: hash partitioned, one
+	IntermediateWriter per partition. This is done with and without the combiner's per-key sums, and
+	with and without LZ4, and the files are read back to check the record counts. The LZ4 codec alone is
+	then timed on the uncompressed intermediate bytes and on the input text.
+
+	usage: compression_bench [input_dir] [scale] [n_partitions]
+	       defaults: the test inputs, 10, 16 (test/config.ini's n_output_files) */
+
+#include "intermediate_io.h"
+#include "lz4_codec.h"
+#include "partitioner.h"
+#include <mr_tokenizer.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+
+namespace {
+
+	using Records = std::vector<std::pair<std::string, std::string>>;
+
+	double seconds_since(std::chrono::steady_clock::time_point start) {
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	/* Writes records (sorted by key) as one intermediate file per partition under dir; returns the total bytes */
+	uint64_t write_partitions(const std::vector<Records>& parts, const fs::path& dir, Compression compression, double& secs) {
+		fs::remove_all(dir);
+		fs::create_directories(dir);
+		const auto start = std::chrono::steady_clock::now();
+		for (size_t r = 0; r < parts.size(); ++r) {
+			IntermediateWriter out;
+			if (!out.open((dir / intermediate_file_name(0, static_cast<int>(r), IntermediateFormat::BINARY)).string(),
+			              IntermediateFormat::BINARY, true, compression)) return 0;
+			for (const auto& [key, val] : parts[r]) out.write(key, val);
+			if (!out.close()) return 0;
+		}
+		secs = seconds_since(start);
+		uint64_t bytes = 0;
+		for (const auto& entry : fs::directory_iterator(dir)) bytes += entry.file_size();
+		return bytes;
+	}
+
+	/* Reads every file under dir back; returns the record count, or -1 on a read error */
+	int64_t read_partitions(const fs::path& dir, double& secs) {
+		const auto start = std::chrono::steady_clock::now();
+		int64_t n = 0;
+		std::string key, val;
+		for (const auto& entry : fs::directory_iterator(dir)) {
+			IntermediateReader in;
+			if (!in.open(entry.path().string())) return -1;
+			while (in.next(key, val)) ++n;
+			if (in.failed()) { std::cerr << entry.path() << ": " << in.error() << std::endl; return -1; }
+		}
+		secs = seconds_since(start);
+		return n;
+	}
+
+	/* One table row: plain and LZ4 sizes of the same records, with write and read times */
+	bool measure(const char* name, const std::vector<Records>& parts, const fs::path& tmp) {
+		size_t n_records = 0;
+		for (const auto& p : parts) n_records += p.size();
+		double w_plain = 0, w_lz4 = 0, r_plain = 0, r_lz4 = 0;
+		const uint64_t plain = write_partitions(parts, tmp / "none", Compression::NONE, w_plain);
+		const uint64_t packed = write_partitions(parts, tmp / "lz4", Compression::LZ4, w_lz4);
+		const int64_t n_plain = read_partitions(tmp / "none", r_plain);
+		const int64_t n_lz4 = read_partitions(tmp / "lz4", r_lz4);
+		if (plain == 0 || packed == 0 || n_plain != static_cast<int64_t>(n_records) || n_lz4 != n_plain) {
+			std::cerr << name << ": write or read back failed" << std::endl;
+			return false;
+		}
+		std::cout << name << ": " << n_records << " records, " << plain / 1024.0 << " KB -> " << packed / 1024.0
+		          << " KB lz4 (" << double(plain) / packed << "x); write " << w_plain * 1000 << " -> " << w_lz4 * 1000
+		          << " ms, read " << r_plain * 1000 << " -> " << r_lz4 * 1000 << " ms" << std::endl;
+		return true;
+	}
+
+	/* Times LZ4 frame compression and decompression of data, and checks the round trip */
+	bool time_codec(const char* name, const std::string& data) {
+		constexpr int kRounds = 5;
+		std::string packed;
+		auto start = std::chrono::steady_clock::now();
+		for (int i = 0; i < kRounds; ++i) {
+			std::ostringstream out;
+			Lz4FrameWriter lz4(out);
+			lz4.write(data.data(), data.size());
+			lz4.finish();
+			packed = out.str();
+		}
+		const double compress_secs = seconds_since(start) / kRounds;
+
+		std::string unpacked(data.size(), '\0');
+		size_t n = 0;
+		bool failed = false;
+		start = std::chrono::steady_clock::now();
+		for (int i = 0; i < kRounds; ++i) {
+			std::istringstream in(packed);
+			Lz4FrameReader lz4(in);
+			n = lz4.read(unpacked.data(), unpacked.size());
+			failed = failed || lz4.failed();
+		}
+		const double decompress_secs = seconds_since(start) / kRounds;
+		const double mb = data.size() / 1048576.0;
+		std::cout << name << ": " << mb << " MB -> " << packed.size() / 1048576.0 << " MB, compress "
+		          << mb / compress_secs << " MB/s, decompress " << mb / decompress_secs << " MB/s" << std::endl;
+		return !failed && n == data.size() && unpacked == data;
+	}
+
+}
+
+
+int main(int argc, char** argv) {
+	const fs::path input_dir = argc > 1 ? argv[1] : TEST_INPUT_DIR;
+	const int scale = argc > 2 ? std::stoi(argv[2]) : 10;
+	const int n_partitions = argc > 3 ? std::stoi(argv[3]) : 16;
+	const fs::path tmp = fs::temp_directory_path() / "mr_compression_bench";
+
+	// 1. what one map task over the inputs emits: a (word, "1") record per token
+	std::string text;
+	for (const char* name : {"testdata_1.txt", "testdata_2.txt", "testdata_3.txt"}) {
+		std::ifstream in(input_dir / name, std::ios::binary);
+		if (!in) { std::cerr << "cannot read " << (input_dir / name) << std::endl; return 1; }
+		std::ostringstream ss;
+		ss << in.rdbuf();
+		text += ss.str();
+		if (!text.empty() && text.back() != '\n') text += '\n';
+	}
+	std::cout << "input: " << text.size() * scale / 1048576.0 << " MB (" << scale << "x the test inputs), "
+	          << n_partitions << " partitions" << std::endl;
+
+	static const DelimiterTokenizer words(" ,.\"'");
+	HashPartitioner partitioner(n_partitions);
+	std::vector<Records> emitted(n_partitions);
+	std::vector<std::map<std::string, uint64_t>> combined(n_partitions);
+	std::string key;
+	for (int s = 0; s < scale; ++s) {
+		size_t pos = 0;
+		while (pos < text.size()) {
+			const size_t nl = text.find('\n', pos);
+			words.for_each(std::string_view(text).substr(pos, nl - pos), [&](std::string_view w) {
+				key.assign(w.data(), w.size());
+				const int r = partitioner.partition(key);
+				emitted[r].emplace_back(key, "1");
+				++combined[r][key];
+			});
+			pos = nl + 1;
+		}
+	}
+	for (auto& part : emitted) std::stable_sort(part.begin(), part.end());
+
+	// 2. intermediates as spilled, then as spilled after the combiner summed each key
+	std::vector<Records> summed(n_partitions);
+	for (int r = 0; r < n_partitions; ++r)
+		for (const auto& [k, n] : combined[r]) summed[r].emplace_back(k, std::to_string(n));
+
+	bool ok = measure("no combiner", emitted, tmp) && measure("combiner   ", summed, tmp);
+
+	// 3. the codec alone, on the uncompressed intermediate bytes without the combiner
+	double unused;
+	ok = ok && write_partitions(emitted, tmp / "none", Compression::NONE, unused) > 0;
+	std::string raw;
+	for (const auto& entry : fs::directory_iterator(tmp / "none")) {
+		std::ifstream in(entry.path(), std::ios::binary);
+		std::ostringstream ss;
+		ss << in.rdbuf();
+		raw += ss.str();
+	}
+	ok = time_codec("codec on intermediates", raw) && ok;
+	ok = time_codec("codec on input text   ", text) && ok;
+
+	fs::remove_all(tmp);
+	std::cout << (ok ? "OK" : "FAILED") << std::endl;
+	return ok ? 0 : 1;
+}
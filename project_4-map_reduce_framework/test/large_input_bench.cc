@@ -0,0 +1,213 @@
+/* Large input check and benchmark for the map input path (64-bit offsets).
+
+	Writes (or reuses) a text file over 4 GB, shards it with shard_files(), sends each shard's pieces
+	through a serialized MapRequest as the master does, and reads every shard back the way the worker
+	does (MappedFile::for_each_line). The default shard size puts one shard across 2^31 and one across
+	2^32. Line count and checksum must match a plain sequential read() of the file, and both passes
+	report their read throughput.
+
+	usage: large_input_bench [path] [file_megabytes] [map_kilobytes]
+	       defaults: /tmp/mr_large_input.txt, 4608 (4.5 GB), 786432 (768 MB shards) */
+
+#include "file_shard.h"
+#include "mapped_file.h"
+#include "masterworker.pb.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+namespace {
+
+	struct Tally {
+		uint64_t lines = 0;
+		uint64_t sum = 0;    // sum of the lines' FNV-1a hashes, so shards can be added in any order
+		uint64_t bytes = 0;
+	};
+
+	inline uint64_t fnv1a(std::string_view s, uint64_t h = 14695981039346656037ull) {
+		for (unsigned char c : s) { h ^= c; h *= 1099511628211ull; }
+		return h;
+	}
+
+	inline void add_line(Tally& t, std::string_view line) {
+		++t.lines;
+		t.sum += fnv1a(line);
+		t.bytes += line.size() + 1;
+	}
+
+	double seconds_since(std::chrono::steady_clock::time_point start) {
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	/* Lines of 1..16 words from a fixed vocabulary, driven by a fixed-seed xorshift, so reruns write the same file */
+	bool generate(const std::string& path, uint64_t size) {
+		static const char* const words[] = {"the", "map", "reduce", "shard", "offset", "worker", "master",
+		                                    "partition", "2147483648", "4294967296", "lorem", "ipsum"};
+		std::FILE* out = std::fopen(path.c_str(), "wb");
+		if (!out) { std::perror(path.c_str()); return false; }
+
+		std::string buf;
+		buf.reserve(4 << 20);
+		uint64_t written = 0, x = 88172645463325252ull;
+		auto next = [&] { x ^= x << 13; x ^= x >> 7; x ^= x << 17; return x; };
+		while (written < size) {
+			const int n_words = 1 + static_cast<int>(next() % 16);
+			for (int w = 0; w < n_words; ++w) {
+				if (w) buf += ' ';
+				buf += words[next() % (sizeof(words) / sizeof(words[0]))];
+			}
+			buf += '\n';
+			if (buf.size() >= (4 << 20) - 256) {
+				if (std::fwrite(buf.data(), 1, buf.size(), out) != buf.size()) { std::perror(path.c_str()); std::fclose(out); return false; }
+				written += buf.size();
+				buf.clear();
+			}
+		}
+		bool ok = std::fwrite(buf.data(), 1, buf.size(), out) == buf.size();
+		ok = std::fclose(out) == 0 && ok;
+		if (!ok) std::perror(path.c_str());
+		return ok;
+	}
+
+	/* Reference: the whole file with read(), lines split across buffer boundaries carried over */
+	bool read_sequential(const std::string& path, Tally& t) {
+		const int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) { std::perror(path.c_str()); return false; }
+		std::vector<char> buf(1 << 20);
+		std::string carry;
+		ssize_t got;
+		while ((got = ::read(fd, buf.data(), buf.size())) > 0) {
+			std::string_view chunk(buf.data(), static_cast<size_t>(got));
+			size_t nl;
+			while ((nl = chunk.find('\n')) != std::string_view::npos) {
+				if (carry.empty()) {
+					add_line(t, chunk.substr(0, nl));
+				} else {
+					carry.append(chunk.data(), nl);
+					add_line(t, carry);
+					carry.clear();
+				}
+				chunk.remove_prefix(nl + 1);
+			}
+			carry.append(chunk.data(), chunk.size());
+		}
+		::close(fd);
+		if (got < 0) { std::perror(path.c_str()); return false; }
+		if (!carry.empty()) { add_line(t, carry); --t.bytes; }  // unterminated last line
+		return true;
+	}
+
+}
+
+
+int main(int argc, char** argv) {
+	const std::string path = argc > 1 ? argv[1] : "/tmp/mr_large_input.txt";
+	const uint64_t file_bytes = (argc > 2 ? std::stoull(argv[2]) : 4608ull) << 20;
+	const int map_kilobytes = argc > 3 ? std::stoi(argv[3]) : 786432;
+	constexpr uint64_t kBoundaries[] = {1ull << 31, 1ull << 32};
+
+	std::error_code ec;
+	const uint64_t existing = std::filesystem::file_size(path, ec);
+	if (ec || existing < file_bytes) {
+		std::cout << "writing " << (file_bytes >> 20) << " MB to " << path << std::endl;
+		const auto start = std::chrono::steady_clock::now();
+		if (!generate(path, file_bytes)) return 1;
+		std::cout << "  written in " << seconds_since(start) << " s" << std::endl;
+	}
+	const uint64_t size = std::filesystem::file_size(path);
+	std::cout << "input: " << path << ", " << size << " bytes" << std::endl;
+	if (size <= kBoundaries[1]) {
+		std::cerr << "input must be larger than 4 GB" << std::endl;
+		return 1;
+	}
+
+	// 1. reference pass
+	Tally expected;
+	auto start = std::chrono::steady_clock::now();
+	if (!read_sequential(path, expected)) return 1;
+	double secs = seconds_since(start);
+	std::cout << "read():       " << expected.lines << " lines, checksum " << std::hex << expected.sum << std::dec
+	          << ", " << (expected.bytes / 1048576.0) / secs << " MB/s" << std::endl;
+
+	// 2. shards as the master cuts them, through the wire format
+	MapReduceSpec spec{};
+	spec.n_workers = 1;
+	spec.input_files = {path};
+	spec.map_kilobytes = map_kilobytes;
+	std::vector<FileShard> shards;
+	if (!shard_files(spec, shards)) return 1;
+
+	std::vector<masterworker::MapRequest> requests;
+	bool crossed[2] = {false, false};
+	uint64_t covered = 0;
+	for (size_t k = 0; k < shards.size(); ++k) {
+		masterworker::MapRequest request;
+		for (const auto& piece : shards[k].pieces) {
+			auto* fp = request.add_file_pieces();
+			fp->set_file_path(piece.filepath);
+			fp->set_start_offset(static_cast<int64_t>(piece.start_offset));
+			fp->set_end_offset(static_cast<int64_t>(piece.end_offset));
+			for (int b = 0; b < 2; ++b) {
+				if (piece.start_offset < kBoundaries[b] && piece.end_offset > kBoundaries[b]) {
+					crossed[b] = true;
+					std::cout << "shard " << k << " [" << piece.start_offset << ", " << piece.end_offset
+					          << ") crosses 2^" << (b ? 32 : 31) << std::endl;
+				}
+			}
+			if (piece.start_offset != covered) {
+				std::cerr << "shard " << k << " starts at " << piece.start_offset << ", expected " << covered << std::endl;
+				return 1;
+			}
+			covered = piece.end_offset;
+		}
+		masterworker::MapRequest received;
+		if (!received.ParseFromString(request.SerializeAsString()) ||
+		    received.file_pieces_size() != request.file_pieces_size()) {
+			std::cerr << "shard " << k << ": MapRequest did not round-trip" << std::endl;
+			return 1;
+		}
+		for (int i = 0; i < received.file_pieces_size(); ++i) {
+			if (received.file_pieces(i).start_offset() != request.file_pieces(i).start_offset() ||
+			    received.file_pieces(i).end_offset() != request.file_pieces(i).end_offset()) {
+				std::cerr << "shard " << k << ": offsets changed on the wire" << std::endl;
+				return 1;
+			}
+		}
+		requests.push_back(std::move(received));
+	}
+	if (covered != size || !crossed[0] || !crossed[1]) {
+		std::cerr << "shards cover " << covered << " of " << size << " bytes"
+		          << (crossed[0] && crossed[1] ? "" : ", and none crosses 2^31 or 2^32 (pick another map_kilobytes)") << std::endl;
+		return 1;
+	}
+	std::cout << shards.size() << " shards of " << map_kilobytes << " KB" << std::endl;
+
+	// 3. the worker's read path, one shard at a time
+	Tally got;
+	start = std::chrono::steady_clock::now();
+	for (const auto& request : requests) {
+		for (const auto& piece : request.file_pieces()) {
+			MappedFile in;
+			if (!in.open(piece.file_path())) return 1;
+			in.for_each_line(static_cast<size_t>(piece.start_offset()), static_cast<size_t>(piece.end_offset()),
+			                 [&](std::string_view line) { add_line(got, line); });
+		}
+	}
+	secs = seconds_since(start);
+	if (got.bytes > size) got.bytes = size;  // an unterminated last line has no '\n' to count
+	std::cout << "map input:    " << got.lines << " lines, checksum " << std::hex << got.sum << std::dec
+	          << ", " << (got.bytes / 1048576.0) / secs << " MB/s" << std::endl;
+
+	const bool ok = got.lines == expected.lines && got.sum == expected.sum;
+	std::cout << (ok ? "OK" : "MISMATCH") << std::endl;
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,159 @@
+/* Task pool benchmark: many small map tasks on one worker, with pooled mappers and with fresh ones.
+
+	Runs word count map tasks (test/user_tasks.cc, combiner on) through Worker::handleMapTask in this
+	process, with no gRPC in between. The input is the bundled test inputs, repeated until there is
+	one shard of shard_kilobytes per task. In the pooled runs every task has user_id cs6210, so after
+	the first one the worker leases the mapper from its pool. In the fresh runs every task gets a
+	user_id of its own, registered with the same mapper, reducer and combiner, so each one misses
+	the pool and builds a mapper through the task factory. The worker's pool counters (the ones its
+	heartbeats report) are read after each run to confirm which path was taken. Intermediates go to
+	work_dir, and each task's output dir is removed before the next task, outside the timing.
+
+	usage: pool_bench [tasks] [shard_kilobytes] [work_dir] [rounds]
+	       defaults: 300, 128, /dev/shm/mr_pool_bench (tmpfs), 5 */
+
+#include "worker.h"
+#include "file_shard.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+
+namespace {
+
+	struct PoolCounts {
+		int64_t created = 0;
+		int64_t reused = 0;
+	};
+
+	PoolCounts pool_counts(Worker& worker) {
+		Heartbeat hb;
+		worker.fillHeartbeat(&hb);
+		return {hb.task_objects_created(), hb.task_objects_reused()};
+	}
+
+	/* Runs one map task per shard; returns the mean time per task in ms */
+	double run_tasks(Worker& worker, const std::vector<FileShard>& shards, const std::string& user_prefix, bool pooled,
+	                 int64_t& next_attempt) {
+		double total_ms = 0;
+		for (size_t i = 0; i < shards.size(); ++i) {
+			MapRequest request;
+			request.set_user_id(pooled ? user_prefix : user_prefix + "_" + std::to_string(next_attempt));
+			request.set_mapper_id(static_cast<int>(i));
+			request.set_intermediate_file_dir("map_" + std::to_string(i));
+			request.set_n_output(16);
+			request.set_intermediate_format(masterworker::INTERMEDIATE_BINARY);
+			request.set_buffer_bytes(64ll << 20);
+			request.set_attempt_id(next_attempt++);
+			request.set_compression(masterworker::COMPRESSION_NONE);
+			request.set_reduce_mode(masterworker::REDUCE_SORTED);
+			for (const auto& piece : shards[i].pieces) {
+				auto* fp = request.add_file_pieces();
+				fp->set_file_path(piece.filepath);
+				fp->set_start_offset(static_cast<int64_t>(piece.start_offset));
+				fp->set_end_offset(static_cast<int64_t>(piece.end_offset));
+			}
+
+			WorkerResponse response;
+			const auto start = std::chrono::steady_clock::now();
+			worker.handleMapTask(&request, &response);
+			total_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			if (!response.success()) {
+				std::cerr << "map task " << i << " failed: " << response.error() << std::endl;
+				return -1;
+			}
+
+			CleanupRequest cleanup;
+			cleanup.set_dir(request.intermediate_file_dir());
+			worker.handleCleanup(&cleanup, &response);
+		}
+		return total_ms / shards.size();
+	}
+
+}
+
+
+int main(int argc, char** argv) {
+	const int n_tasks = argc > 1 ? std::stoi(argv[1]) : 300;
+	const int shard_kilobytes = argc > 2 ? std::stoi(argv[2]) : 128;
+	const fs::path work_dir = argc > 3 ? argv[3] : "/dev/shm/mr_pool_bench";
+	const int rounds = argc > 4 ? std::stoi(argv[4]) : 5;
+
+	// input: the test inputs back to back until every task has a full shard
+	fs::remove_all(work_dir);
+	fs::create_directories(work_dir);
+	std::string text;
+	for (const char* name : {"testdata_1.txt", "testdata_2.txt", "testdata_3.txt"}) {
+		std::ifstream in(fs::path(TEST_INPUT_DIR) / name, std::ios::binary);
+		std::ostringstream ss;
+		ss << in.rdbuf();
+		text += ss.str();
+		if (!text.empty() && text.back() != '\n') text += '\n';
+	}
+	const std::string input = (work_dir / "input.txt").string();
+	{
+		std::ofstream out(input, std::ios::binary);
+		for (uint64_t written = 0; written < uint64_t(n_tasks) * shard_kilobytes * 1024; written += text.size()) out << text;
+	}
+	MapReduceSpec spec{};
+	spec.n_workers = 1;
+	spec.input_files = {input};
+	spec.map_kilobytes = shard_kilobytes;
+	std::vector<FileShard> shards;
+	if (!shard_files(spec, shards)) return 1;
+	shards.resize(std::min<size_t>(shards.size(), n_tasks));
+
+	// the same word count tasks under one user_id per fresh task
+	std::function<std::shared_ptr<BaseMapper>()> mapper = [] { return get_mapper_from_task_factory("cs6210"); };
+	std::function<std::shared_ptr<BaseReducer>()> reducer = [] { return get_reducer_from_task_factory("cs6210"); };
+	std::function<std::shared_ptr<BaseCombiner>()> combiner = [] { return get_combiner_from_task_factory("cs6210"); };
+	const int n_fresh = static_cast<int>(shards.size()) * (rounds + 1);
+	for (int id = 0; id < n_fresh; ++id) register_tasks("fresh_" + std::to_string(id), mapper, reducer, combiner);
+
+	Worker worker("localhost:0", 1, work_dir.string());
+	std::cout << shards.size() << " map tasks of " << shard_kilobytes << " KB, intermediates in " << work_dir << std::endl;
+
+	// the worker logs every task; keep that out of the results
+	std::ostringstream worker_log;
+	auto* cout_buf = std::cout.rdbuf(worker_log.rdbuf());
+	int64_t fresh_attempt = 0, pooled_attempt = 1000000000;
+	run_tasks(worker, shards, "fresh", false, fresh_attempt);     // warm-up: page cache, allocator
+	run_tasks(worker, shards, "cs6210", true, pooled_attempt);
+
+	std::vector<double> fresh_ms, pooled_ms;
+	PoolCounts fresh_counts, pooled_counts;
+	bool ok = true;
+	for (int r = 0; r < rounds && ok; ++r) {
+		PoolCounts before = pool_counts(worker);
+		fresh_ms.push_back(run_tasks(worker, shards, "fresh", false, fresh_attempt));
+		PoolCounts after = pool_counts(worker);
+		fresh_counts.created += after.created - before.created;
+		fresh_counts.reused  += after.reused - before.reused;
+
+		before = after;
+		pooled_ms.push_back(run_tasks(worker, shards, "cs6210", true, pooled_attempt));
+		after = pool_counts(worker);
+		pooled_counts.created += after.created - before.created;
+		pooled_counts.reused  += after.reused - before.reused;
+		ok = fresh_ms.back() >= 0 && pooled_ms.back() >= 0;
+	}
+	std::cout.rdbuf(cout_buf);
+	fs::remove_all(work_dir);
+	if (!ok) return 1;
+
+	auto median = [](std::vector<double> v) { std::sort(v.begin(), v.end()); return v[v.size() / 2]; };
+	std::cout << "fresh:  " << median(fresh_ms) << " ms/task (median of " << rounds << " rounds), pool built "
+	          << fresh_counts.created << ", reused " << fresh_counts.reused << std::endl;
+	std::cout << "pooled: " << median(pooled_ms) << " ms/task (median of " << rounds << " rounds), pool built "
+	          << pooled_counts.created << ", reused " << pooled_counts.reused << std::endl;
+	std::cout << "saving: " << 100.0 * (1.0 - median(pooled_ms) / median(fresh_ms)) << "%" << std::endl;
+	return 0;
+}
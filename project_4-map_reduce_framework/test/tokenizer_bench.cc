@@ -0,0 +1,103 @@
+/* Tokenizer microbenchmark: DelimiterTokenizer against the strtok_r loop of the reference mapper.
+
+	Every line of the bundled test inputs is split on the word count delimiters, passes times over.
+	The strtok_r loop copies each line first, as UserMapper::map in test/user_tasks.cc does. The
+	tokenizer runs once with those delimiters (the SIMD path: AVX2, or SSE2 in the tokenizer_bench_sse2
+	build) and once with delimiters added that never occur in the input, which selects the lookup
+	table. All runs must see the same tokens.
+
+	usage: tokenizer_bench [input_dir] [passes]
+	       defaults: the test inputs, 50 */
+
+#include <mr_tokenizer.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+namespace {
+
+	constexpr const char* kDelims = " ,.\"'";
+
+	struct Tokens {
+		uint64_t n = 0;
+		uint64_t sum = 0;   // of the tokens' lengths and first and last bytes, in order: cheap next to the split
+
+		void add(std::string_view w) {
+			++n;
+			sum = sum * 31 + w.size() * 65536 + static_cast<unsigned char>(w.front()) * 256 + static_cast<unsigned char>(w.back());
+		}
+		bool operator==(const Tokens& o) const { return n == o.n && sum == o.sum; }
+	};
+
+	/* Runs split over every line passes times; prints and returns the throughput in MB/s */
+	template <typename Split>
+	double run(const char* name, const std::vector<std::string>& lines, uint64_t bytes, int passes, Tokens& tokens, Split split) {
+		const auto start = std::chrono::steady_clock::now();
+		for (int p = 0; p < passes; ++p) {
+			Tokens t;
+			for (const auto& line : lines) split(line, t);
+			tokens = t;
+		}
+		const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		const double mb_s = bytes * double(passes) / 1048576.0 / secs;
+		std::cout << name << mb_s << " MB/s, " << tokens.n << " tokens" << std::endl;
+		return mb_s;
+	}
+
+}
+
+
+int main(int argc, char** argv) {
+	const std::filesystem::path input_dir = argc > 1 ? argv[1] : TEST_INPUT_DIR;
+	const int passes = argc > 2 ? std::stoi(argv[2]) : 50;
+
+	std::vector<std::string> lines;
+	uint64_t bytes = 0;
+	for (const char* name : {"testdata_1.txt", "testdata_2.txt", "testdata_3.txt"}) {
+		std::ifstream in(input_dir / name, std::ios::binary);
+		if (!in) { std::cerr << "cannot read " << (input_dir / name) << std::endl; return 1; }
+		std::string line;
+		while (std::getline(in, line)) {
+			bytes += line.size() + 1;
+			lines.push_back(std::move(line));
+		}
+	}
+	std::cout << "input: " << lines.size() << " lines, " << bytes / 1024 << " KB, " << passes << " passes" << std::endl;
+#ifdef MR_TOKENIZER_NO_AVX2
+	const char* simd = "tokenizer (SSE2):   ";
+#else
+	const char* simd = __builtin_cpu_supports("avx2") ? "tokenizer (AVX2):   " : "tokenizer (SSE2):   ";
+#endif
+
+	Tokens reference, simd_tokens, table_tokens;
+	const double base = run("strtok_r:           ", lines, bytes, passes, reference,
+	                        [](const std::string& line, Tokens& t) {
+		char* c_input = new char[line.length() + 1];
+		std::strcpy(c_input, line.c_str());
+		char* save_pointer;
+		for (char* w = strtok_r(c_input, kDelims, &save_pointer); w; w = strtok_r(nullptr, kDelims, &save_pointer)) t.add(w);
+		delete[] c_input;
+	});
+
+	static const DelimiterTokenizer words(kDelims);
+	const double fast = run(simd, lines, bytes, passes, simd_tokens,
+	                        [](const std::string& line, Tokens& t) { words.for_each(line, [&](std::string_view w) { t.add(w); }); });
+
+	// more than MAX_SIMD_DELIMS delimiters; the extra ones do not occur in the inputs
+	static const DelimiterTokenizer table(std::string(kDelims) + "\x01\x02\x03\x04");
+	const double lookup = run("tokenizer (table):  ", lines, bytes, passes, table_tokens,
+	                          [](const std::string& line, Tokens& t) { table.for_each(line, [&](std::string_view w) { t.add(w); }); });
+
+	std::cout << "speedup: " << fast / base << "x SIMD, " << lookup / base << "x lookup table" << std::endl;
+	const bool ok = simd_tokens == reference && table_tokens == reference;
+	std::cout << (ok ? "OK" : "MISMATCH") << std::endl;
+	return ok ? 0 : 1;
+}
